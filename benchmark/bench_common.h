@@ -0,0 +1,114 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_BENCH_COMMON_H
+#define POINT_CLOUD_PLANE_DETECTION_BENCH_COMMON_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "json_writer.h"
+#include "utils.h"
+
+namespace bench {
+
+/**
+ * Wall clock seconds since an arbitrary epoch
+ */
+inline double now_s() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Reset the peak resident set size of the process (Linux 4.0+), returns false where not supported
+ */
+inline bool reset_peak_rss() {
+    std::ofstream ofs("/proc/self/clear_refs");
+    if (!ofs.is_open()) return false;
+    ofs << "5";
+    return (bool) ofs;
+}
+
+/**
+ * Peak resident set size of the process in bytes (VmHWM), -1 where not available
+ */
+inline long long peak_rss_bytes() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::stoll(line.substr(6)) * 1024;
+    }
+    return -1;
+}
+
+/**
+ * Summary of repeated measurements of one configuration
+ */
+struct Sample {
+    double min_s = 0, median_s = 0, mean_s = 0, max_s = 0;
+    int repeats = 0;
+};
+
+inline Sample summarize(std::vector<double> times) {
+    Sample s;
+    s.repeats = (int) times.size();
+    if (times.empty()) return s;
+    std::sort(times.begin(), times.end());
+    s.min_s = times.front();
+    s.max_s = times.back();
+    size_t mid = times.size() / 2;
+    s.median_s = times.size() % 2 ? times[mid] : 0.5 * (times[mid - 1] + times[mid]);
+    double sum = 0;
+    for (double t : times) sum += t;
+    s.mean_s = sum / times.size();
+    return s;
+}
+
+using pd::JsonWriter;
+
+/**
+ * Plane models for synthetic clouds, all of them cross the cube [-size, size]^3
+ */
+inline std::vector<cv::Vec4f> synthetic_models(int num_planes, float size, uint64_t seed) {
+    cv::RNG rng(seed);
+    std::vector<cv::Vec4f> models;
+    for (int i = 0; i < num_planes; ++i) {
+        models.emplace_back(rng.uniform(-0.5f, 0.5f), rng.uniform(-0.5f, 0.5f), 1.0f,
+                            rng.uniform(-0.5f * size, 0.5f * size));
+    }
+    return models;
+}
+
+/**
+ * Synthetic cloud of n points, 90% on num_planes planes and 10% uniform noise in a cube of side 2 * size
+ */
+inline cv::Mat synthetic_cloud(int n, int num_planes, float size, uint64_t seed = 1) {
+    int noise_num = n / 10, point_num = n - noise_num;
+    cv::Mat cloud(n, 3, CV_32F);
+    point_cloud_generator(size, point_num, noise_num, synthetic_models(num_planes, size, seed), cloud);
+    return cloud;
+}
+
+/**
+ * Parse a comma separated list such as "1,5,10"
+ */
+template<typename T>
+std::vector<T> parse_list(const std::string &s) {
+    std::vector<T> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        std::stringstream is(item);
+        T v;
+        is >> v;
+        out.push_back(v);
+    }
+    return out;
+}
+
+}  // namespace bench
+
+#endif //POINT_CLOUD_PLANE_DETECTION_BENCH_COMMON_H
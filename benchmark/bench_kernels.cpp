@@ -0,0 +1,307 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "parallel.h"
+#include "ransac_kernels.h"
+#include "ransac_opencv.h"
+#include "utils.h"
+#include "bench_common.h"
+
+using namespace std;
+
+/*
+ * Micro-benchmark of every kernel in ransac.cpp, and of scalar type and policy variants from ransac_kernels.h, on
+ * synthetic clouds from point_cloud_generator, and scaling study of get_planes over thread counts and problem sizes
+ */
+void usage() {
+    printf("Usage:  bench_kernels [options]\n"
+           "\t--mode m\t\t kernels: time every kernel, scaling: time get_planes over --threads and --sizes (default kernels)\n"
+           "\t--sizes n1,n2,...\t\t Point cloud sizes (default 1000,...,10000000, scaling mode 10000,...,100000000)\n"
+           "\t--planes k1,k2,...\t\t Number of planes in the cloud (default 1,2,5,10,20,50, scaling mode 10)\n"
+           "\t--threads t1,t2,...\t\t Scaling mode thread counts (default 1,2,4,... up to the number of CPUs)\n"
+           "\t--format f\t\t Scaling mode output format, json or csv (default json)\n"
+           "\t--kernels a,b,...\t\t Subset of voxel_grid,get_inliers,get_inliers_double,get_inliers_int16,\n"
+           "\t\t\t\t tls,get_plane,get_plane_distinct,get_plane_int16,get_planes (default all)\n"
+           "\t--repeats r\t\t Repetitions of every measurement (default 5)\n"
+           "\t--thr t\t\t Distance threshold (default 0.2)\n"
+           "\t--grid g\t\t Voxel size for voxel_grid and get_planes (default 0.5)\n"
+           "\t--iters i\t\t RANSAC iterations for get_plane and get_planes (default 1000)\n"
+           "\t--output path\t\t Output file (default bench_kernels.json or bench_scaling.json / .csv)\n");
+}
+
+struct Config {
+    string mode = "kernels", format = "json";
+    vector<int> sizes = {1000, 10000, 100000, 1000000, 10000000};
+    vector<int> planes = {1, 2, 5, 10, 20, 50};
+    vector<int> threads;
+    vector<string> kernels = {"voxel_grid", "get_inliers", "get_inliers_double", "get_inliers_int16", "tls",
+                              "get_plane", "get_plane_distinct", "get_plane_int16", "get_planes"};
+    int repeats = 5;
+    float thr = 0.2f, grid = 0.5f, size = 100.f;
+    int iters = 1000;
+    string output;
+};
+
+bool wants(const Config &cfg, const string &kernel) {
+    return find(cfg.kernels.begin(), cfg.kernels.end(), kernel) != cfg.kernels.end();
+}
+
+/*
+ * Time one kernel invocation repeatedly, `work` is the number of points the kernel touches per call
+ */
+template<typename F>
+void run(bench::JsonWriter &json, const Config &cfg, const char *kernel, int n, int num_planes,
+         double work, F f) {
+    vector<double> times;
+    for (int r = 0; r < cfg.repeats; ++r) {
+        double start = bench::now_s();
+        f();
+        times.push_back(bench::now_s() - start);
+    }
+    bench::Sample s = bench::summarize(times);
+    json.begin_object()
+            .field("kernel", kernel)
+            .field("points", n)
+            .field("planes", num_planes)
+            .field("repeats", s.repeats)
+            .field("min_s", s.min_s)
+            .field("median_s", s.median_s)
+            .field("mean_s", s.mean_s)
+            .field("max_s", s.max_s)
+            .field("throughput_pts_per_s", s.median_s > 0 ? work / s.median_s : 0.0)
+            .end_object();
+    fprintf(stderr, "%-12s n=%-9d planes=%-3d median %.6f s\n", kernel, n, num_planes, s.median_s);
+}
+
+struct ScalingResult {
+    int points, threads;
+    double time_s, speedup, efficiency;
+    long long peak_rss_bytes;
+};
+
+/*
+ * Run get_planes for every size and thread count. Speedup and efficiency are relative to the smallest thread
+ * count of the same size. The peak RSS is reset before every configuration where the kernel supports it.
+ */
+int run_scaling(const Config &cfg) {
+    vector<int> threads = cfg.threads;
+    if (threads.empty()) {
+        for (int t = 1; t < cv::getNumberOfCPUs(); t *= 2) threads.push_back(t);
+        threads.push_back(cv::getNumberOfCPUs());
+    }
+    sort(threads.begin(), threads.end());
+    const int num_planes = cfg.planes.front();
+
+    vector<ScalingResult> results;
+    for (int n : cfg.sizes) {
+        double base_time = 0;
+        int base_threads = threads.front();
+        for (int t : threads) {
+            cv::Mat cloud;
+            {
+                SceneConfig scene;
+                scene.num_points = n;
+                scene.noise_sigma = 0.05f;
+                scene.size = cfg.size;
+                scene.patches = random_plane_patches(num_planes, cfg.size, 1);
+                generate_scene(cloud, nullptr, scene);
+            }
+            pd::set_num_threads(t);
+            bench::reset_peak_rss();
+            vector<double> times;
+            for (int r = 0; r < cfg.repeats; ++r) {
+                cv::Mat labels;
+                vector<cv::Vec4f> planes;
+                double start = bench::now_s();
+                get_planes(labels, planes, cloud, cfg.thr, cfg.iters, num_planes, cfg.grid);
+                times.push_back(bench::now_s() - start);
+            }
+            ScalingResult res;
+            res.points = n;
+            res.threads = t;
+            res.time_s = bench::summarize(times).median_s;
+            if (t == base_threads) base_time = res.time_s;
+            res.speedup = res.time_s > 0 ? base_time / res.time_s : 0;
+            res.efficiency = res.speedup * base_threads / t;
+            res.peak_rss_bytes = bench::peak_rss_bytes();
+            results.push_back(res);
+            fprintf(stderr, "n=%-10d threads=%-3d median %.6f s speedup %.2f efficiency %.2f peak RSS %lld MiB\n",
+                    n, t, res.time_s, res.speedup, res.efficiency, res.peak_rss_bytes >> 20);
+        }
+    }
+    pd::set_num_threads(0);
+
+    const string output = !cfg.output.empty() ? cfg.output : cfg.format == "csv" ? "bench_scaling.csv"
+                                                                                   : "bench_scaling.json";
+    ofstream ofs(output);
+    if (!ofs.is_open()) {
+        cerr << "ofstream open file error!\n";
+        return 1;
+    }
+    if (cfg.format == "csv") {
+        ofs << "points,threads,time_s,speedup,efficiency,peak_rss_bytes\n";
+        for (const ScalingResult &r : results) {
+            ofs << r.points << "," << r.threads << "," << r.time_s << "," << r.speedup << "," << r.efficiency << ","
+                << r.peak_rss_bytes << "\n";
+        }
+        return 0;
+    }
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("benchmark", "get_planes_scaling")
+            .field("planes", num_planes)
+            .field("thr", cfg.thr)
+            .field("grid_size", cfg.grid)
+            .field("max_iterations", cfg.iters)
+            .field("repeats", cfg.repeats)
+            .begin_array("results");
+    for (const ScalingResult &r : results) {
+        json.begin_object()
+                .field("points", r.points)
+                .field("threads", r.threads)
+                .field("median_s", r.time_s)
+                .field("speedup", r.speedup)
+                .field("efficiency", r.efficiency)
+                .field("peak_rss_bytes", r.peak_rss_bytes)
+                .end_object();
+    }
+    json.end_array().end_object();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Config cfg;
+    bool sizes_set = false, planes_set = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        string val = argv[++i];
+        if (arg == "--mode") cfg.mode = val;
+        else if (arg == "--sizes") cfg.sizes = bench::parse_list<int>(val), sizes_set = true;
+        else if (arg == "--planes") cfg.planes = bench::parse_list<int>(val), planes_set = true;
+        else if (arg == "--threads") cfg.threads = bench::parse_list<int>(val);
+        else if (arg == "--format") cfg.format = val;
+        else if (arg == "--kernels") cfg.kernels = bench::parse_list<string>(val);
+        else if (arg == "--repeats") cfg.repeats = stoi(val);
+        else if (arg == "--thr") cfg.thr = stof(val);
+        else if (arg == "--grid") cfg.grid = stof(val);
+        else if (arg == "--iters") cfg.iters = stoi(val);
+        else if (arg == "--output") cfg.output = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (cfg.mode == "scaling") {
+        if (!sizes_set) cfg.sizes = {10000, 100000, 1000000, 10000000, 100000000};
+        if (!planes_set) cfg.planes = {10};
+        return run_scaling(cfg);
+    } else if (cfg.mode != "kernels") {
+        usage();
+        return 1;
+    }
+
+    ofstream ofs(cfg.output.empty() ? "bench_kernels.json" : cfg.output);
+    if (!ofs.is_open()) {
+        cerr << "ofstream open file error!\n";
+        return 1;
+    }
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("benchmark", "ransac_kernels")
+            .field("thr", cfg.thr)
+            .field("grid_size", cfg.grid)
+            .field("max_iterations", cfg.iters)
+            .begin_array("results");
+
+    for (int n : cfg.sizes) {
+        for (int num_planes : cfg.planes) {
+            cv::Mat cloud = bench::synthetic_cloud(n, num_planes, cfg.size), buffer;
+            const pd::PointCloud points = to_point_cloud(cloud, buffer);
+            const pd::Vec4f model0 = to_pd(bench::synthetic_models(num_planes, cfg.size, 1)[0]);
+            bool *inliers = new bool[n];
+            // The same cloud in the other scalar types of ransac_kernels.h
+            vector<double> points_double(points.data(), points.data() + 3 * (size_t) n);
+            const pd::PointSpan<double> span_double(points_double.data(), n);
+            vector<int16_t> points_int16;
+            const pd::PointSpan<int16_t> span_int16 = pd::quantise(points, points_int16);
+
+            if (wants(cfg, "voxel_grid")) {
+                run(json, cfg, "voxel_grid", n, num_planes, n, [&]() {
+                    pd::PointCloud sampled;
+                    VoxelGrid(sampled, points, cfg.grid, cfg.grid, cfg.grid);
+                });
+            }
+            if (wants(cfg, "get_inliers")) {
+                run(json, cfg, "get_inliers", n, num_planes, n, [&]() {
+                    get_inliers(inliers, model0, points, cfg.thr);
+                });
+            }
+            if (wants(cfg, "get_inliers_double")) {
+                const pd::Vec<double, 4> model(model0[0], model0[1], model0[2], model0[3]);
+                run(json, cfg, "get_inliers_double", n, num_planes, n, [&]() {
+                    pd::get_inliers<pd::NoPruning>(inliers, model, span_double, cfg.thr);
+                });
+            }
+            if (wants(cfg, "get_inliers_int16")) {
+                run(json, cfg, "get_inliers_int16", n, num_planes, n, [&]() {
+                    pd::get_inliers<pd::NoPruning>(inliers, model0, span_int16, cfg.thr);
+                });
+            }
+            if (wants(cfg, "tls")) {
+                // Sample sizes used by the minimal sample, get_plane LO and get_planes LO respectively
+                const int sample_sizes[] = {3, 20, 300}, calls = 1000;
+                for (int sample_num : sample_sizes) {
+                    if (sample_num > n) continue;
+                    vector<int> sample(sample_num * calls);
+                    cv::RNG rng(sample_num);
+                    for (int &s : sample) s = rng.uniform(0, n);
+                    string name = "tls_" + to_string(sample_num);
+                    run(json, cfg, name.c_str(), n, num_planes, (double) sample_num * calls, [&]() {
+                        pd::Vec4f model;
+                        for (int c = 0; c < calls; ++c)
+                            total_least_squares_plane_estimate(model, points, &sample[c * sample_num], sample_num);
+                    });
+                }
+            }
+            if (wants(cfg, "get_plane")) {
+                run(json, cfg, "get_plane", n, num_planes, n, [&]() {
+                    pd::Vec4f model;
+                    get_plane(model, inliers, points, cfg.thr, cfg.iters, nullptr, 0.06);
+                });
+            }
+            if (wants(cfg, "get_plane_distinct")) {
+                run(json, cfg, "get_plane_distinct", n, num_planes, n, [&]() {
+                    pd::Vec4f model;
+                    pd::DistinctSampler sampler;
+                    pd::get_plane<pd::Pruning>(model, inliers, points.span(), cfg.thr, cfg.iters,
+                                               pd::NoNormalConstraint(), sampler);
+                });
+            }
+            if (wants(cfg, "get_plane_int16")) {
+                run(json, cfg, "get_plane_int16", n, num_planes, n, [&]() {
+                    pd::Vec4f model;
+                    pd::UniformSampler sampler;
+                    pd::get_plane<pd::Pruning>(model, inliers, span_int16, cfg.thr, cfg.iters,
+                                               pd::NoNormalConstraint(), sampler);
+                });
+            }
+            if (wants(cfg, "get_planes")) {
+                run(json, cfg, "get_planes", n, num_planes, n, [&]() {
+                    cv::Mat labels;
+                    vector<cv::Vec4f> planes;
+                    get_planes(labels, planes, cloud, cfg.thr, cfg.iters, num_planes, cfg.grid);
+                });
+            }
+            delete[] inliers;
+        }
+    }
+
+    json.end_array().end_object();
+    return 0;
+}
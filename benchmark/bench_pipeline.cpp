@@ -0,0 +1,118 @@
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "frame_pipeline.h"
+#include "ransac_opencv.h"
+#include "utils.h"
+#include "bench_common.h"
+
+using namespace std;
+
+/*
+ * Staged pipeline benchmark: runs read -> get_planes -> save over a list of PLY files through FramePipeline and
+ * sequentially, and reports the time, latency and queue depth of every stage
+ */
+void usage() {
+    printf("Usage:  bench_pipeline [options]\n"
+           "\t--files a.ply,b.ply,...\t\t Frames, in order (required)\n"
+           "\t--repeat r\t\t Times the list is played (default 10)\n"
+           "\t--planes k\t\t Planes per frame (default 3)\n"
+           "\t--thr t\t\t Distance threshold (default 0.2)\n"
+           "\t--grid g\t\t Voxel size (default 0.2)\n"
+           "\t--iters i\t\t RANSAC iterations (default 1000)\n"
+           "\t--pool p\t\t Frames in flight (default 4)\n"
+           "\t--queue q\t\t Capacity of the queues between stages (default 2)\n"
+           "\t--budget b\t\t End to end latency budget in seconds (default 0.05)\n"
+           "\t--output path\t\t JSON results (default bench_pipeline.json)\n");
+}
+
+void write_stage(bench::JsonWriter &json, const char *name, const pd::StageStats &stage) {
+    const double frames = max(1LL, stage.frames);
+    json.begin_object(name)
+            .field("frames", stage.frames).field("mean_s", stage.total_s / frames).field("max_s", stage.max_s)
+            .field("mean_wait_s", stage.total_wait_s / frames)
+            .field("mean_queue_depth", stage.total_queue_depth / frames)
+            .field("max_queue_depth", stage.max_queue_depth)
+            .end_object();
+    printf("  %-7s mean %8.3f ms, max %8.3f ms, waiting %8.3f ms, queue depth mean %.2f max %d\n", name,
+           1e3 * stage.total_s / frames, 1e3 * stage.max_s, 1e3 * stage.total_wait_s / frames,
+           stage.total_queue_depth / frames, stage.max_queue_depth);
+}
+
+int main(int argc, char *argv[]) {
+    vector<string> files;
+    int repeat = 10;
+    pd::PipelineOptions options;
+    options.params.desired_num_planes = 3;
+    options.params.threshold = 0.2f;
+    options.params.grid_size = 0.2f;
+    options.params.max_iterations = 1000;
+    string output = "bench_pipeline.json";
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        string val = argv[++i];
+        if (arg == "--files") files = bench::parse_list<string>(val);
+        else if (arg == "--repeat") repeat = stoi(val);
+        else if (arg == "--planes") options.params.desired_num_planes = stoi(val);
+        else if (arg == "--thr") options.params.threshold = stof(val);
+        else if (arg == "--grid") options.params.grid_size = stof(val);
+        else if (arg == "--iters") options.params.max_iterations = stoi(val);
+        else if (arg == "--pool") options.pool_frames = stoi(val);
+        else if (arg == "--queue") options.queue_capacity = stoi(val);
+        else if (arg == "--budget") options.latency_budget_s = stod(val);
+        else if (arg == "--output") output = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 1;
+    }
+    vector<string> frames;
+    for (int r = 0; r < repeat; ++r) frames.insert(frames.end(), files.begin(), files.end());
+    const string suffix = "-pipeline-label.txt";
+
+    // Sequential reference: every frame is read, detected and saved before the next one starts, as quiet as the
+    // detect stage of the pipeline
+    set_print_progress(false);
+    const pd_params &p = options.params;
+    double start = bench::now_s();
+    for (const string &path : frames) {
+        cv::Mat points, labels;
+        vector<cv::Vec4f> planes;
+        if (!read_point_cloud_ply_to_mat(points, path)) return 1;
+        get_planes(labels, planes, points, p.threshold, p.max_iterations, p.desired_num_planes, p.grid_size);
+        save_points_label(path + suffix, labels);
+    }
+    const double sequential_s = bench::now_s() - start;
+
+    pd::FramePipeline pipeline(options);
+    start = bench::now_s();
+    pd::PipelineStats stats = pipeline.run(pd::FramePipeline::ply_files(frames),
+                                           pd::FramePipeline::label_files(suffix));
+    const double pipeline_s = bench::now_s() - start;
+    for (const string &path : files) remove((path + suffix).c_str());
+
+    printf("%d frames: sequential %.3f s, pipeline %.3f s (%.2fx), latency mean %.3f ms max %.3f ms, "
+           "%lld over the %.0f ms budget\n", (int) frames.size(), sequential_s, pipeline_s,
+           sequential_s / pipeline_s, 1e3 * stats.total_latency_s / max(1LL, stats.frames),
+           1e3 * stats.max_latency_s, stats.over_budget, 1e3 * options.latency_budget_s);
+
+    ofstream ofs(output);
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("frames", (int) frames.size()).field("sequential_s", sequential_s).field("pipeline_s", pipeline_s)
+            .field("latency_mean_s", stats.total_latency_s / max(1LL, stats.frames))
+            .field("latency_max_s", stats.max_latency_s).field("over_budget", stats.over_budget);
+    write_stage(json, "read", stats.read);
+    write_stage(json, "detect", stats.detect);
+    write_stage(json, "write", stats.write);
+    json.end_object();
+    ofs << "\n";
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "ransac_opencv.h"
+#include "utils.h"
+#include "profiler.h"
+#include "bench_common.h"
+
+#ifdef __linux__
+#include <sys/utsname.h>
+#endif
+
+using namespace std;
+
+/*
+ * Performance regression harness: times the get_planes stages on fixed deterministic scenes and compares them
+ * with a stored baseline
+ */
+void usage() {
+    printf("Usage:  bench_regression [options]\n"
+           "\t--data dir\t\t Directory with check.ply and Cassette_GT_.ply-sampling-0.2.ply (default ./data)\n"
+           "\t--repeats r\t\t Runs per scene (default 10)\n"
+           "\t--output path\t\t JSON results, usable as a later baseline (default bench_regression.json)\n"
+           "\t--baseline path\t\t Baseline JSON to compare with (default: none)\n"
+           "\t--tolerance t\t\t Relative slowdown tolerated before failing (default 0.05)\n"
+           "\t--confidence c\t\t Confidence level of the comparison, 0.9, 0.95 or 0.99 (default 0.95)\n");
+}
+
+struct Scene {
+    string name, path;
+    int desired_num_planes, max_iterations;
+    float thr, grid_size;
+};
+
+// Stage name -> one total time per run
+typedef map<string, vector<double>> StageSamples;
+
+struct SceneResult {
+    string name;
+    int points;
+    StageSamples stages;
+};
+
+string cpu_model() {
+    ifstream ifs("/proc/cpuinfo");
+    string line;
+    while (getline(ifs, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != string::npos) return line.substr(colon + 2);
+        }
+    }
+    return "unknown";
+}
+
+string os_name() {
+#ifdef __linux__
+    utsname u;
+    if (uname(&u) == 0) return string(u.sysname) + " " + u.release + " " + u.machine;
+#endif
+    return "unknown";
+}
+
+SceneResult run_scene(const Scene &scene, const cv::Mat &cloud, int repeats) {
+    SceneResult result;
+    result.name = scene.name;
+    result.points = cloud.rows;
+    for (int r = 0; r < repeats; ++r) {
+        profiler::reset();
+        cv::Mat labels;
+        vector<cv::Vec4f> planes;
+        get_planes(labels, planes, cloud, scene.thr, scene.max_iterations, scene.desired_num_planes,
+                   scene.grid_size);
+        for (const profiler::StageStats &s : profiler::stage_stats()) result.stages[s.name].push_back(s.total_s);
+    }
+    fprintf(stderr, "%-12s %d points, get_planes median %.6f s\n", scene.name.c_str(), result.points,
+            bench::summarize(result.stages["get_planes"]).median_s);
+    return result;
+}
+
+/*
+ * Two sided critical value of Student's t distribution, Cornish-Fisher expansion around the normal quantile
+ */
+double t_critical(double confidence, double df) {
+    const double z = confidence >= 0.99 ? 2.5758293 : confidence >= 0.95 ? 1.9599640 : 1.6448536;
+    const double z3 = z * z * z, z5 = z3 * z * z;
+    return z + (z3 + z) / (4 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df);
+}
+
+void mean_var(const vector<double> &v, double &mean, double &var) {
+    mean = var = 0;
+    for (double x : v) mean += x;
+    mean /= v.size();
+    for (double x : v) var += (x - mean) * (x - mean);
+    var = v.size() > 1 ? var / (v.size() - 1) : 0;
+}
+
+/*
+ * Welch confidence interval of the difference of means, a stage regresses if the whole interval lies above
+ * tolerance times the baseline mean
+ */
+bool compare(const vector<SceneResult> &current, const map<string, StageSamples> &baseline, double tolerance,
+             double confidence) {
+    bool regression = false;
+    printf("-----------------------------------------------------------------------------------------------\n");
+    printf(" Scene \t\t Stage \t\t baseline (s) \t current (s) \t change \t %.0f%% CI of change \t verdict\n",
+           confidence * 100);
+    for (const SceneResult &scene : current) {
+        auto base_scene = baseline.find(scene.name);
+        if (base_scene == baseline.end()) {
+            printf(" %-12s \t not in baseline\n", scene.name.c_str());
+            continue;
+        }
+        for (const auto &stage : scene.stages) {
+            auto base_stage = base_scene->second.find(stage.first);
+            if (base_stage == base_scene->second.end() || base_stage->second.empty()) continue;
+            const vector<double> &a = base_stage->second, &b = stage.second;
+            double mean_a, var_a, mean_b, var_b;
+            mean_var(a, mean_a, var_a);
+            mean_var(b, mean_b, var_b);
+            const double se_a = var_a / a.size(), se_b = var_b / b.size(), se = sqrt(se_a + se_b);
+            // Welch-Satterthwaite degrees of freedom
+            double df = (a.size() > 1 && b.size() > 1 && se > 0)
+                        ? (se_a + se_b) * (se_a + se_b) /
+                          (se_a * se_a / (a.size() - 1) + se_b * se_b / (b.size() - 1))
+                        : 1;
+            const double half_width = t_critical(confidence, max(df, 1.0)) * se;
+            const double diff = mean_b - mean_a, low = diff - half_width, high = diff + half_width;
+            const char *verdict = "ok";
+            if (mean_a > 0 && low > tolerance * mean_a) {
+                verdict = "REGRESSION";
+                regression = true;
+            } else if (mean_a > 0 && high < -tolerance * mean_a) {
+                verdict = "faster";
+            }
+            printf(" %-12s \t %-14s \t %f \t %f \t %+.1f%% \t [%+.1f%%, %+.1f%%] \t %s\n", scene.name.c_str(),
+                   stage.first.c_str(), mean_a, mean_b, mean_a > 0 ? 100 * diff / mean_a : 0.0,
+                   mean_a > 0 ? 100 * low / mean_a : 0.0, mean_a > 0 ? 100 * high / mean_a : 0.0, verdict);
+        }
+    }
+    printf("-----------------------------------------------------------------------------------------------\n");
+    return regression;
+}
+
+bool read_baseline(const string &path, map<string, StageSamples> &baseline) {
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        cerr << "Cannot open baseline " << path << "\n";
+        return false;
+    }
+    cv::FileNode scenes = fs["scenes"];
+    for (const cv::FileNode &scene : scenes) {
+        string name = (string) scene["name"];
+        cv::FileNode stages = scene["stages"];
+        for (const string &stage : stages.keys()) {
+            vector<double> samples;
+            stages[stage] >> samples;
+            baseline[name][stage] = samples;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    string data_dir = "./data", output = "bench_regression.json", baseline_path;
+    int repeats = 10;
+    double tolerance = 0.05, confidence = 0.95;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 2;
+        }
+        string val = argv[++i];
+        if (arg == "--data") data_dir = val;
+        else if (arg == "--repeats") repeats = stoi(val);
+        else if (arg == "--output") output = val;
+        else if (arg == "--baseline") baseline_path = val;
+        else if (arg == "--tolerance") tolerance = stod(val);
+        else if (arg == "--confidence") confidence = stod(val);
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    profiler::set_enabled(true);
+
+    // Parameters of the README demos, plus a synthetic scene with a fixed seed
+    const Scene scenes[] = {
+            {"check", data_dir + "/check.ply", 3, 1000, 0.2f, 0.2f},
+            {"cassette", data_dir + "/Cassette_GT_.ply-sampling-0.2.ply", 3, 1000, 0.5f, 0.22f},
+            {"synthetic", "", 5, 1000, 0.2f, 0.5f},
+    };
+    vector<SceneResult> results;
+    for (const Scene &scene : scenes) {
+        cv::Mat cloud;
+        if (scene.path.empty()) {
+            SceneConfig config;
+            config.num_points = 1000000;
+            config.noise_sigma = 0.05f;
+            config.seed = 2021;
+            config.patches = random_plane_patches(scene.desired_num_planes, config.size, config.seed);
+            generate_scene(cloud, nullptr, config);
+        } else if (!read_point_cloud_ply_to_mat(cloud, scene.path)) {
+            cerr << "Skipping scene " << scene.name << "\n";
+            continue;
+        }
+        results.push_back(run_scene(scene, cloud, repeats));
+    }
+
+    ofstream ofs(output);
+    if (!ofs.is_open()) {
+        cerr << "ofstream open file error!\n";
+        return 2;
+    }
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("benchmark", "regression")
+            .begin_object("hardware")
+            .field("cpu", cpu_model())
+            .field("logical_cpus", (int) thread::hardware_concurrency())
+            .field("os", os_name())
+#ifdef __VERSION__
+            .field("compiler", __VERSION__)
+#endif
+            .field("opencv", CV_VERSION)
+            .end_object()
+            .field("repeats", repeats)
+            .begin_array("scenes");
+    for (const SceneResult &r : results) {
+        json.begin_object().field("name", r.name).field("points", r.points).begin_object("stages");
+        for (const auto &stage : r.stages) {
+            json.begin_array(stage.first.c_str());
+            for (double t : stage.second) json.value(t);
+            json.end_array();
+        }
+        json.end_object().end_object();
+    }
+    json.end_array().end_object();
+    ofs.close();
+
+    if (baseline_path.empty()) return 0;
+    map<string, StageSamples> baseline;
+    if (!read_baseline(baseline_path, baseline)) return 2;
+    return compare(results, baseline, tolerance, confidence) ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include <fstream>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "detection_client.h"
+#include "detection_server.h"
+#include "ransac.h"
+#include "bench_common.h"
+
+using namespace std;
+
+/*
+ * Round trip benchmark of the detection server: streams synthetic frames through DetectionClient, keeping up to
+ * --depth of them in flight, and compares the frame latency with calling pd_get_planes in process
+ */
+void usage() {
+    printf("Usage:  bench_server [options]\n"
+           "\t--socket path\t\t Server to connect to (default: start one in process on /tmp/bench_server.sock)\n"
+           "\t--points n\t\t Points per frame (default 20000)\n"
+           "\t--planes k\t\t Planes per frame (default 3)\n"
+           "\t--frames f\t\t Frames to send (default 200)\n"
+           "\t--depth d\t\t Frames in flight (default 4)\n"
+           "\t--queue q\t\t Queue capacity of the in process server (default 16)\n"
+           "\t--output path\t\t JSON results (default bench_server.json)\n");
+}
+
+int main(int argc, char *argv[]) {
+    string socket_path, output = "bench_server.json";
+    int points = 20000, num_planes = 3, frames = 200, depth = 4, queue = 16;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        string val = argv[++i];
+        if (arg == "--socket") socket_path = val;
+        else if (arg == "--points") points = stoi(val);
+        else if (arg == "--planes") num_planes = stoi(val);
+        else if (arg == "--frames") frames = stoi(val);
+        else if (arg == "--depth") depth = max(1, stoi(val));
+        else if (arg == "--queue") queue = stoi(val);
+        else if (arg == "--output") output = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    pd::DetectionServer server;
+    if (socket_path.empty()) {
+        pd::ServerOptions options;
+        options.socket_path = socket_path = "/tmp/bench_server.sock";
+        options.queue_capacity = queue;
+        if (!server.start(options)) return 1;
+    }
+
+    cv::Mat cloud = bench::synthetic_cloud(points, num_planes, 100.f);
+    pd_params params;
+    pd_default_params(&params);
+    params.threshold = 0.2f;
+    params.max_iterations = 1000;
+    params.desired_num_planes = num_planes;
+
+    // In process reference, as quiet as the detectors of the server
+    set_print_progress(false);
+    vector<int32_t> labels(points);
+    vector<float> planes(4 * num_planes);
+    vector<double> local_times;
+    for (int f = 0; f < min(frames, 20); ++f) {
+        double start = bench::now_s();
+        pd_get_planes((const float *) cloud.data, points, 0, &params, labels.data(), planes.data(), num_planes, nullptr);
+        local_times.push_back(bench::now_s() - start);
+    }
+
+    pd::DetectionClient client;
+    if (!client.connect(socket_path, (size_t) 16 * points * (depth + 1) + (1 << 20))) return 1;
+
+    // Latency is measured from submit to receive, so with depth > 1 it includes the wait behind earlier frames
+    vector<double> submitted(frames + 1), latencies, queue_times, detect_times;
+    int failed = 0;
+    auto take = [&](pd::DetectionResult &result) {
+        latencies.push_back(bench::now_s() - submitted[result.id]);
+        queue_times.push_back(result.queue_s);
+        detect_times.push_back(result.detect_s);
+        if (result.status != PD_OK) ++failed;
+    };
+    double start = bench::now_s();
+    pd::DetectionResult result;
+    for (int f = 0; f < frames; ++f) {
+        while (client.in_flight() >= depth && client.receive(result)) take(result);
+        double t = bench::now_s();
+        uint64_t id = client.submit((const float *) cloud.data, points, params);
+        if (id == 0) return 1;
+        submitted[id] = t;
+    }
+    while (client.receive(result)) take(result);
+    double total = bench::now_s() - start;
+    client.disconnect();
+
+    bench::Sample local = bench::summarize(local_times), latency = bench::summarize(latencies);
+    bench::Sample queued = bench::summarize(queue_times), detect = bench::summarize(detect_times);
+    printf("frames %d, %d points, depth %d: %.1f frames/s, latency median %.3f ms (in process %.3f ms), "
+           "queue wait median %.3f ms, detection median %.3f ms, failed %d\n",
+           frames, points, depth, frames / total, 1e3 * latency.median_s, 1e3 * local.median_s,
+           1e3 * queued.median_s, 1e3 * detect.median_s, failed);
+
+    ofstream ofs(output);
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("points", points).field("planes", num_planes).field("frames", frames).field("depth", depth)
+            .field("frames_per_s", frames / total).field("failed", failed)
+            .field("latency_median_s", latency.median_s).field("latency_max_s", latency.max_s)
+            .field("in_process_median_s", local.median_s)
+            .field("queue_median_s", queued.median_s).field("detect_median_s", detect.median_s)
+            .end_object();
+    ofs << "\n";
+    return failed == 0 ? 0 : 1;
+}
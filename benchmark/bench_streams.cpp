@@ -0,0 +1,109 @@
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "stream_scheduler.h"
+#include "bench_common.h"
+
+using namespace std;
+
+/*
+ * Multi-stream benchmark: feeds --streams synthetic streams at --rate frames per second each into one
+ * StreamScheduler and reports the latency and the deadline misses of every stream
+ */
+void usage() {
+    printf("Usage:  bench_streams [options]\n"
+           "\t--streams s\t\t Number of streams (default 8)\n"
+           "\t--points n\t\t Points per frame (default 50000)\n"
+           "\t--planes k\t\t Planes per frame (default 3)\n"
+           "\t--frames f\t\t Frames per stream (default 50)\n"
+           "\t--rate r\t\t Frames per second of every stream, 0 to submit all at once (default 10)\n"
+           "\t--budget b\t\t Latency budget of a frame in seconds (default 0.1)\n"
+           "\t--concurrency c\t\t Frames detected at the same time, 0 for the number of threads (default 0)\n"
+           "\t--output path\t\t JSON results (default bench_streams.json)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int streams = 8, points = 50000, num_planes = 3, frames = 50, concurrency = 0;
+    double rate = 10, budget = 0.1;
+    string output = "bench_streams.json";
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        string val = argv[++i];
+        if (arg == "--streams") streams = stoi(val);
+        else if (arg == "--points") points = stoi(val);
+        else if (arg == "--planes") num_planes = stoi(val);
+        else if (arg == "--frames") frames = stoi(val);
+        else if (arg == "--rate") rate = stod(val);
+        else if (arg == "--budget") budget = stod(val);
+        else if (arg == "--concurrency") concurrency = stoi(val);
+        else if (arg == "--output") output = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    // A different scene per stream, every frame of a stream reuses it
+    vector<cv::Mat> clouds;
+    for (int s = 0; s < streams; ++s) clouds.push_back(bench::synthetic_cloud(points, num_planes, 100.f, s + 1));
+
+    pd::StreamScheduler scheduler(concurrency);
+    pd::StreamOptions options;
+    pd_default_params(&options.params);
+    options.params.threshold = 0.2f;
+    options.params.max_iterations = 1000;
+    options.params.desired_num_planes = num_planes;
+    options.latency_budget_s = budget;
+    for (int s = 0; s < streams; ++s) scheduler.add_stream(options);
+
+    mutex latencies_mutex;
+    vector<vector<double>> latencies(streams);
+    auto done = [&](const pd::FrameResult &result) {
+        lock_guard<mutex> lock(latencies_mutex);
+        latencies[result.stream].push_back(result.latency_s);
+    };
+
+    // Streams are offset by a fraction of the frame period, like sensors that are not synchronised
+    const double start = bench::now_s(), period = rate > 0 ? 1 / rate : 0;
+    for (int f = 0; f < frames; ++f) {
+        for (int s = 0; s < streams; ++s) {
+            const double due = start + period * (f + (double) s / streams);
+            const double wait = due - bench::now_s();
+            if (wait > 0) this_thread::sleep_for(chrono::duration<double>(wait));
+            scheduler.submit(s, pd::PointCloud((const float *) clouds[s].data, points), done);
+        }
+    }
+    scheduler.wait_idle();
+    const double total = bench::now_s() - start;
+
+    ofstream ofs(output);
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("streams", streams).field("points", points).field("frames", frames).field("rate", rate)
+            .field("budget_s", budget).field("total_s", total)
+            .begin_array("per_stream");
+    long long misses = 0;
+    for (int s = 0; s < streams; ++s) {
+        pd::StreamStats stats = scheduler.stats(s);
+        bench::Sample sample = bench::summarize(latencies[s]);
+        misses += stats.deadline_misses;
+        printf("stream %d: frames %lld, latency median %.3f ms, max %.3f ms, deadline misses %lld, dropped %lld\n",
+               s, stats.frames, 1e3 * sample.median_s, 1e3 * stats.max_latency_s, stats.deadline_misses,
+               stats.dropped);
+        json.begin_object()
+                .field("stream", s).field("frames", stats.frames).field("latency_median_s", sample.median_s)
+                .field("latency_max_s", stats.max_latency_s).field("deadline_misses", stats.deadline_misses)
+                .field("dropped", stats.dropped)
+                .end_object();
+    }
+    json.end_array().field("deadline_misses", misses).end_object();
+    ofs << "\n";
+    printf("%d streams x %d frames in %.3f s, %lld deadline misses\n", streams, frames, total, misses);
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <opencv2/opencv.hpp>
+#include "ransac_opencv.h"
+#include "utils.h"
+#include "bench_common.h"
+
+using namespace std;
+
+/*
+ * Accuracy versus time evaluation of get_planes against ground truth labels
+ */
+void usage() {
+    printf("Usage:  eval_accuracy [options]\n"
+           "\t--cloud path\t\t Point cloud file (default ./data/check.ply)\n"
+           "\t--labels path\t\t Ground truth label file (default ./data/check_label.txt)\n"
+           "\t--planes k\t\t Number of planes to detect (default: number of ground truth planes)\n"
+           "\t--thr t1,t2,...\t\t Distance thresholds to sweep (default 0.05,0.1,0.2,0.5)\n"
+           "\t--grid g1,g2,...\t\t Grid sizes to sweep, <= 0 disables down sampling (default 0,0.2,0.5,1)\n"
+           "\t--iters i1,i2,...\t\t Maximum iterations to sweep (default 100,1000,5000)\n"
+           "\t--weighted w1,...\t\t Weighted voxel scoring to sweep, 0 or 1 (default 0)\n"
+           "\t--repeats r\t\t Runs per configuration, the median time is reported (default 3)\n"
+           "\t--output path\t\t JSON output file (default eval_accuracy.json)\n");
+}
+
+struct PlaneScore {
+    int gt_label = 0, pred_label = 0;
+    double iou = 0, precision = 0, recall = 0;
+};
+
+struct RunResult {
+    float thr = 0, grid = 0;
+    int iters = 0;
+    bool weighted = false;
+    double time_s = 0, mean_iou = 0, mean_precision = 0, mean_recall = 0;
+    vector<PlaneScore> planes;
+    bool pareto = false;
+};
+
+/*
+ * Match predicted planes to ground truth planes one to one, greedily by IoU, and score every ground truth plane
+ */
+vector<PlaneScore> score_planes(const cv::Mat &gt, const cv::Mat &pred) {
+    const int *gt_ptr = (const int *) gt.data, *pred_ptr = (const int *) pred.data;
+    map<int, int> gt_size, pred_size;
+    map<pair<int, int>, int> overlap;
+    for (int i = 0; i < gt.rows; ++i) {
+        int g = gt_ptr[i], p = pred_ptr[i];
+        if (g > 0) ++gt_size[g];
+        if (p > 0) ++pred_size[p];
+        if (g > 0 && p > 0) ++overlap[make_pair(g, p)];
+    }
+
+    struct Candidate {
+        double iou;
+        int g, p, inter;
+    };
+    vector<Candidate> candidates;
+    for (auto &o : overlap) {
+        int g = o.first.first, p = o.first.second, inter = o.second;
+        candidates.push_back({(double) inter / (gt_size[g] + pred_size[p] - inter), g, p, inter});
+    }
+    sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.iou > b.iou; });
+
+    map<int, PlaneScore> scores;
+    for (auto &g : gt_size) scores[g.first].gt_label = g.first;
+    map<int, bool> pred_used;
+    for (auto &c : candidates) {
+        if (scores[c.g].pred_label != 0 || pred_used[c.p]) continue;
+        pred_used[c.p] = true;
+        PlaneScore &s = scores[c.g];
+        s.pred_label = c.p;
+        s.iou = c.iou;
+        s.precision = (double) c.inter / pred_size[c.p];
+        s.recall = (double) c.inter / gt_size[c.g];
+    }
+
+    vector<PlaneScore> out;
+    for (auto &s : scores) out.push_back(s.second);
+    return out;
+}
+
+/*
+ * A run is on the Pareto front if no other run is at least as fast and at least as accurate, and strictly better in one
+ */
+void mark_pareto(vector<RunResult> &runs) {
+    for (auto &r : runs) {
+        r.pareto = true;
+        for (auto &o : runs) {
+            if (o.time_s <= r.time_s && o.mean_iou >= r.mean_iou &&
+                (o.time_s < r.time_s || o.mean_iou > r.mean_iou)) {
+                r.pareto = false;
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    string cloud_path = "./data/check.ply", label_path = "./data/check_label.txt", output = "eval_accuracy.json";
+    vector<float> thrs = {0.05f, 0.1f, 0.2f, 0.5f}, grids = {0.f, 0.2f, 0.5f, 1.f};
+    vector<int> iters_list = {100, 1000, 5000}, weighted_list = {0};
+    int desired_num_planes = 0, repeats = 3;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        string val = argv[++i];
+        if (arg == "--cloud") cloud_path = val;
+        else if (arg == "--labels") label_path = val;
+        else if (arg == "--planes") desired_num_planes = stoi(val);
+        else if (arg == "--thr") thrs = bench::parse_list<float>(val);
+        else if (arg == "--grid") grids = bench::parse_list<float>(val);
+        else if (arg == "--iters") iters_list = bench::parse_list<int>(val);
+        else if (arg == "--weighted") weighted_list = bench::parse_list<int>(val);
+        else if (arg == "--repeats") repeats = stoi(val);
+        else if (arg == "--output") output = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    cv::Mat cloud, gt;
+    if (!read_point_cloud_ply_to_mat(cloud, cloud_path) || !read_points_label(gt, label_path)) return 1;
+    if (gt.rows != cloud.rows) {
+        cerr << "Label count " << gt.rows << " does not match point count " << cloud.rows << "\n";
+        return 1;
+    }
+    if (desired_num_planes <= 0) {
+        const int *gt_ptr = (const int *) gt.data;
+        map<int, int> gt_planes;
+        for (int i = 0; i < gt.rows; ++i) if (gt_ptr[i] > 0) ++gt_planes[gt_ptr[i]];
+        desired_num_planes = (int) gt_planes.size();
+    }
+
+    vector<RunResult> runs;
+    for (float thr : thrs) {
+        for (float grid : grids) {
+            for (int iters : iters_list) {
+                for (int weighted : weighted_list) {
+                    // Weighting only changes anything on a down sampled cloud
+                    if (weighted && grid <= 0) continue;
+                    RunResult r;
+                    r.thr = thr;
+                    r.grid = grid;
+                    r.iters = iters;
+                    r.weighted = weighted != 0;
+                    vector<double> times;
+                    cv::Mat labels;
+                    for (int rep = 0; rep < repeats; ++rep) {
+                        vector<cv::Vec4f> planes;
+                        double start = bench::now_s();
+                        get_planes(labels, planes, cloud, thr, iters, desired_num_planes, grid, nullptr, 0.06,
+                                   nullptr, r.weighted);
+                        times.push_back(bench::now_s() - start);
+                    }
+                    r.time_s = bench::summarize(times).median_s;
+                    r.planes = score_planes(gt, labels);
+                    for (auto &p : r.planes) {
+                        r.mean_iou += p.iou;
+                        r.mean_precision += p.precision;
+                        r.mean_recall += p.recall;
+                    }
+                    if (!r.planes.empty()) {
+                        r.mean_iou /= r.planes.size();
+                        r.mean_precision /= r.planes.size();
+                        r.mean_recall /= r.planes.size();
+                    }
+                    runs.push_back(r);
+                }
+            }
+        }
+    }
+    mark_pareto(runs);
+
+    ofstream ofs(output);
+    if (!ofs.is_open()) {
+        cerr << "ofstream open file error!\n";
+        return 1;
+    }
+    bench::JsonWriter json(ofs);
+    json.begin_object()
+            .field("benchmark", "accuracy_vs_time")
+            .field("cloud", cloud_path)
+            .field("labels", label_path)
+            .field("desired_num_planes", desired_num_planes)
+            .begin_array("runs");
+    for (auto &r : runs) {
+        json.begin_object()
+                .field("thr", r.thr)
+                .field("grid_size", r.grid)
+                .field("max_iterations", r.iters)
+                .field("weighted", r.weighted)
+                .field("time_s", r.time_s)
+                .field("mean_iou", r.mean_iou)
+                .field("mean_precision", r.mean_precision)
+                .field("mean_recall", r.mean_recall)
+                .field("pareto", r.pareto)
+                .begin_array("planes");
+        for (auto &p : r.planes) {
+            json.begin_object()
+                    .field("gt_label", p.gt_label)
+                    .field("pred_label", p.pred_label)
+                    .field("iou", p.iou)
+                    .field("precision", p.precision)
+                    .field("recall", p.recall)
+                    .end_object();
+        }
+        json.end_array().end_object();
+    }
+    json.end_array().end_object();
+
+    // Pareto table, fastest first
+    vector<RunResult> front;
+    for (auto &r : runs) if (r.pareto) front.push_back(r);
+    sort(front.begin(), front.end(), [](const RunResult &a, const RunResult &b) { return a.time_s < b.time_s; });
+    printf("-----------------------------------------------------------------------------------------------\n");
+    printf(" Pareto front (%d of %d configurations)\n", (int) front.size(), (int) runs.size());
+    printf(" thr \t grid_size \t max_iters \t weighted \t time (s) \t mean IoU \t precision \t recall \n");
+    for (auto &r : front) {
+        printf(" %.3f \t %.3f \t\t %d \t\t %d \t\t %.4f \t %.4f \t %.4f \t %.4f \n", r.thr, r.grid, r.iters,
+               (int) r.weighted, r.time_s, r.mean_iou, r.mean_precision, r.mean_recall);
+    }
+    printf("-----------------------------------------------------------------------------------------------\n");
+    return 0;
+}
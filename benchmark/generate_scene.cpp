@@ -0,0 +1,67 @@
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "parallel.h"
+#include "utils.h"
+#include "bench_common.h"
+
+using namespace std;
+
+/*
+ * Synthetic scene generator for load tests, writes binary PLY and optionally ground truth labels
+ */
+void usage() {
+    printf("Usage:  generate_scene [options]\n"
+           "\t--points n\t\t Number of points, outliers included (default 1000000)\n"
+           "\t--planes k\t\t Number of random plane patches (default 5)\n"
+           "\t--outlier-ratio r\t\t Fraction of uniform outliers (default 0.1)\n"
+           "\t--noise s\t\t Standard deviation of the noise along the plane normal (default 0.05)\n"
+           "\t--size s\t\t Outliers fill [-s, s]^3, patches are scaled to it (default 100)\n"
+           "\t--seed s\t\t Random seed (default 1)\n"
+           "\t--threads t\t\t Number of threads, 0 for all (default 0)\n"
+           "\t--output path\t\t Binary PLY output (default scene.ply)\n"
+           "\t--labels path\t\t Label output, one per line, 0 for outliers (default: none)\n");
+}
+
+int main(int argc, char *argv[]) {
+    SceneConfig config;
+    config.num_points = 1000000;
+    config.noise_sigma = 0.05f;
+    int num_planes = 5, threads = 0;
+    string output = "scene.ply", label_path;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc || arg == "--help") {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        string val = argv[++i];
+        if (arg == "--points") config.num_points = stoll(val);
+        else if (arg == "--planes") num_planes = stoi(val);
+        else if (arg == "--outlier-ratio") config.outlier_ratio = stof(val);
+        else if (arg == "--noise") config.noise_sigma = stof(val);
+        else if (arg == "--size") config.size = stof(val);
+        else if (arg == "--seed") config.seed = stoull(val);
+        else if (arg == "--threads") threads = stoi(val);
+        else if (arg == "--output") output = val;
+        else if (arg == "--labels") label_path = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (threads > 0) pd::set_num_threads(threads);
+    config.patches = random_plane_patches(num_planes, config.size, config.seed);
+
+    double start = bench::now_s();
+    if (!generate_scene_ply(output, config, label_path)) return 1;
+    double duration = bench::now_s() - start;
+    printf("Generated %lld points on %d planes in %f s (%.0f points/s), path: %s\n", config.num_points, num_planes,
+           duration, config.num_points / duration, output.c_str());
+    for (int k = 0; k < num_planes; ++k) {
+        const PlanePatch &p = config.patches[k];
+        printf(" %d \t center (%f, %f, %f) \t normal (%f, %f, %f) \t half extents %f x %f\n", k + 1,
+               p.center[0], p.center[1], p.center[2], p.normal[0], p.normal[1], p.normal[2],
+               p.half_width, p.half_height);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_DETECTION_CLIENT_H
+#define POINT_CLOUD_PLANE_DETECTION_DETECTION_CLIENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "plane_detection.h"
+#include "point_cloud.h"
+
+/*
+ * Client of DetectionServer (detection_server.h). Frames are copied into a shared memory ring mapped by both
+ * processes, so neither the points nor the labels go through the socket. Several frames may be in flight: submit
+ * blocks while the ring has no room, which together with the bounded queue of the server throttles a producer
+ * that is faster than the detector.
+ */
+namespace pd {
+
+struct DetectionResult {
+    uint64_t id = 0;
+    pd_status status = PD_ERROR_INTERNAL;
+    std::vector<Vec4f> planes;    // In descending order of inliers
+    std::vector<int32_t> labels;  // 0 for points of no plane, otherwise the 1-based index of the plane in planes
+    double queue_s = 0;           // Time the request waited for a detector
+    double detect_s = 0;          // Time of the detection in the server
+};
+
+class DetectionClient {
+public:
+    DetectionClient();
+
+    ~DetectionClient();
+
+    /**
+     * Connect to the server listening on socket_path
+     *
+     * @param ring_bytes  Size of the shared ring, a frame of n points needs 16 n bytes of it while in flight
+     * @return false on failure, the reason is printed to stderr
+     */
+    bool connect(const std::string &socket_path, size_t ring_bytes = 64 << 20);
+
+    void disconnect();
+
+    /**
+     * Queue the detection of n packed x, y, z points, waiting for earlier frames to finish while the ring is full
+     *
+     * @return Id of the request, matched by DetectionResult::id; 0 on failure
+     */
+    uint64_t submit(const float *xyz, int n, const pd_params &params);
+
+    /**
+     * Wait for the next finished request, in completion order
+     *
+     * @return false if nothing is in flight or the connection failed
+     */
+    bool receive(DetectionResult &result);
+
+    /**
+     * Submit one frame and wait for its result, results of other requests that arrive meanwhile are kept for receive
+     */
+    bool detect(DetectionResult &result, const float *xyz, int n, const pd_params &params);
+
+    /**
+     * Requests submitted and not received yet
+     */
+    int in_flight() const { return (int) in_flight_.size() + (int) finished_.size(); }
+
+private:
+    struct Slot {
+        uint64_t id;
+        size_t offset, bytes;
+        int num_points;
+        bool done;
+    };
+
+    bool allocate(size_t bytes, size_t &offset);
+
+    bool read_reply();
+
+    int fd_;
+    char *ring_;
+    size_t ring_bytes_, head_;
+    uint64_t next_id_;
+    std::deque<Slot> in_flight_;            // In submission order, ring space is freed from the front
+    std::deque<DetectionResult> finished_;  // Received while submit or detect waited, in completion order
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_DETECTION_CLIENT_H
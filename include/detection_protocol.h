@@ -0,0 +1,88 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_DETECTION_PROTOCOL_H
+#define POINT_CLOUD_PLANE_DETECTION_DETECTION_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include "plane_detection.h"
+
+/*
+ * Messages between DetectionClient and DetectionServer, both ends run on the same machine so fields are in native
+ * byte order.
+ *
+ *   client                                       server
+ *   Hello, ring memfd attached (SCM_RIGHTS)  ->
+ *                                            <-  HelloReply
+ *   DetectRequest                            ->  queued, blocks the connection while the queue is full
+ *   DetectRequest                            ->
+ *                                            <-  DetectReply + num_planes * 4 floats, in completion order
+ *
+ * Points and labels are exchanged through the ring, a shared memory buffer owned by the client: a request names
+ * where its points are and where its labels go, and the client must not touch either until the reply arrives.
+ * The ring must be at least the size the Hello claims and, on Linux, a memfd sealed against shrinking and growing.
+ */
+namespace pd {
+namespace protocol {
+
+const uint32_t magic = 0x34445050;  // "PPD4", pd_params gained its version
+const int max_planes = 256;
+
+enum MessageType : uint32_t {
+    hello = 1,
+    detect = 2
+};
+
+struct Hello {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t ring_bytes;
+};
+
+struct HelloReply {
+    int32_t status;
+    int32_t queue_capacity;
+};
+
+struct DetectRequest {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t id;
+    uint64_t points_offset;  // Packed x, y, z floats in the ring
+    uint64_t labels_offset;  // int32 labels in the ring
+    uint64_t num_points;
+    pd_params params;
+};
+
+struct DetectReply {
+    uint64_t id;
+    int32_t status;          // pd_status
+    uint32_t num_planes;     // Followed by num_planes * 4 floats a, b, c, d
+    double queue_s;          // Time spent waiting for a detector
+    double detect_s;         // Time of the detection
+};
+
+/**
+ * Write the whole buffer to a socket, retrying on interrupts and short writes
+ */
+bool send_all(int fd, const void *data, size_t size);
+
+/**
+ * Read exactly size bytes from a socket, false on error or when the peer closed the connection
+ */
+bool recv_all(int fd, void *data, size_t size);
+
+/**
+ * send_all with a file descriptor attached as SCM_RIGHTS ancillary data
+ */
+bool send_with_fd(int fd, const void *data, size_t size, int attached_fd);
+
+/**
+ * recv_all of a message sent by send_with_fd
+ *
+ * @param attached_fd  The received descriptor (output), -1 if none was attached
+ */
+bool recv_with_fd(int fd, void *data, size_t size, int &attached_fd);
+
+}  // namespace protocol
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_DETECTION_PROTOCOL_H
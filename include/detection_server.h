@@ -0,0 +1,79 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_DETECTION_SERVER_H
+#define POINT_CLOUD_PLANE_DETECTION_DETECTION_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "plane_detection.h"
+
+/*
+ * Detection daemon for POSIX systems: a long running process that detects planes for local clients, so they pay
+ * neither the start up of a process nor a round trip of the points through files. Clients connect over a Unix
+ * domain socket and exchange points and labels through a shared memory ring, see detection_protocol.h and
+ * DetectionClient in detection_client.h.
+ */
+namespace pd {
+
+struct ServerOptions {
+    std::string socket_path;
+    int queue_capacity = 16;  // Requests waiting for a detector, a connection blocks while the queue is full
+    int detectors = 1;        // Requests detected at the same time, every detection also uses the thread pool
+};
+
+class DetectionServer {
+public:
+    DetectionServer();
+
+    ~DetectionServer();
+
+    /**
+     * Listen on options.socket_path, replacing a stale socket file, and start serving in background threads
+     *
+     * @return false if the socket cannot be created, the reason is printed to stderr
+     */
+    bool start(const ServerOptions &options);
+
+    /**
+     * Stop accepting, close every connection and return once the requests being detected are done; queued
+     * requests are dropped
+     */
+    void stop();
+
+    /**
+     * Requests waiting for a detector
+     */
+    int queue_depth();
+
+private:
+    struct Connection;
+    struct Job;
+
+    void accept_loop();
+
+    void connection_loop(std::shared_ptr<Connection> connection);
+
+    void detector_loop();
+
+    ServerOptions options_;
+    int listen_fd_;
+    std::atomic<bool> stopping_;
+    std::thread accept_thread_;
+    std::vector<std::thread> detector_threads_;
+
+    std::mutex connections_mutex_;
+    std::condition_variable connections_closed_;
+    std::vector<std::shared_ptr<Connection>> connections_;  // Open connections, each served by a detached thread
+
+    std::mutex queue_mutex_;
+    std::condition_variable queue_not_empty_, queue_not_full_;
+    std::deque<std::unique_ptr<Job>> queue_;
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_DETECTION_SERVER_H
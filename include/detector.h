@@ -0,0 +1,66 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_DETECTOR_H
+#define POINT_CLOUD_PLANE_DETECTION_DETECTOR_H
+
+#include <string>
+#include <vector>
+#include "plane_detection.h"
+#include "point_cloud.h"
+#include "ransac.h"
+
+/*
+ * Detector context of one stream of frames: its parameters, and the labels, planes and statistics of its last
+ * frame, whose buffers are reused from frame to frame.
+ */
+namespace pd {
+
+/**
+ * Check the values of detection parameters, shared by pd_get_planes and Detector
+ *
+ * @param error  Reason of the failure (output)
+ * @return PD_OK or PD_ERROR_INVALID_ARGUMENT
+ */
+pd_status validate_params(const pd_params &params, std::string &error);
+
+class Detector {
+public:
+    explicit Detector(const pd_params &params);
+
+    /**
+     * Detect the planes of a frame, the results stay in labels(), planes() and stats() until the next call
+     *
+     * @return PD_OK, or the reason of the failure as in pd_get_planes, described by error()
+     */
+    pd_status detect(const PointCloud &frame);
+
+    const pd_params &params() const { return params_; }
+
+    void set_params(const pd_params &params) { params_ = params; }
+
+    /**
+     * Label of every point of the last frame, 0 for no plane, otherwise the 1-based index of its plane in planes()
+     */
+    const std::vector<int> &labels() const { return labels_; }
+
+    /**
+     * Planes of the last frame in descending order of inliers
+     */
+    const std::vector<Vec4f> &planes() const { return planes_; }
+
+    const RansacStats &stats() const { return stats_; }
+
+    /**
+     * Message of the last failure, empty after a successful detect
+     */
+    const std::string &error() const { return error_; }
+
+private:
+    pd_params params_;
+    std::vector<int> labels_;
+    std::vector<Vec4f> planes_;
+    RansacStats stats_;
+    std::string error_;
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_DETECTOR_H
@@ -0,0 +1,113 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_FRAME_PIPELINE_H
+#define POINT_CLOUD_PLANE_DETECTION_FRAME_PIPELINE_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "plane_detection.h"
+#include "ransac.h"
+#include "spsc_queue.h"
+
+/*
+ * Staged pipeline read -> get_planes -> save: every stage runs on its own thread, so reading the next frame and
+ * writing the last one overlap with the detection of the current one.
+ *
+ * The stages pass frame handles through bounded SpscQueues; no point or label is copied between stages. Frames
+ * come from a fixed pool and go back to it after the output stage, so their cv::Mat buffers are reused and a
+ * source that runs ahead blocks on the empty pool instead of allocating.
+ */
+namespace pd {
+
+struct PipelineFrame {
+    uint64_t number = 0;
+    std::string path;                         // Set by the source, used by the default source and sink
+    cv::Mat points;                           // n × 3 float, filled by the source
+    cv::Mat labels;                           // n × 1 int, filled by the detection stage
+    std::vector<cv::Vec4f> planes;
+    RansacStats stats;
+    bool ok = false;                          // The source and the detection succeeded
+    double read_start = 0, read_end = 0;      // profiler::now_s() timestamps of every stage
+    double detect_start = 0, detect_end = 0;
+    double write_start = 0, write_end = 0;
+};
+
+struct PipelineOptions {
+    pd_params params;                         // Detection parameters
+    int pool_frames = 4;                      // Frames in flight at most
+    int queue_capacity = 2;                   // Capacity of each queue between two stages
+    double latency_budget_s = 0.05;           // End to end latency, from the start of read to the end of write
+
+    PipelineOptions() { pd_default_params(&params); }
+};
+
+struct StageStats {
+    long long frames = 0;
+    double total_s = 0, max_s = 0;            // Time spent in the stage
+    double total_wait_s = 0;                  // Time spent waiting for the previous stage or a free frame
+    long long total_queue_depth = 0;          // Sum over the frames of the depth of the queue the stage took them
+                                              // from, counting the frame; free frames of the pool for read
+    int max_queue_depth = 0;
+};
+
+struct PipelineStats {
+    StageStats read, detect, write;
+    long long frames = 0, over_budget = 0;
+    double total_latency_s = 0, max_latency_s = 0;
+};
+
+class FramePipeline {
+public:
+    /**
+     * Fill a frame and set frame.ok, false at the end of the stream; a frame it throws on is passed on as failed
+     */
+    typedef std::function<bool(PipelineFrame &)> Source;
+
+    /**
+     * Consume a detected frame, called for failed frames as well
+     */
+    typedef std::function<void(PipelineFrame &)> Sink;
+
+    explicit FramePipeline(const PipelineOptions &options);
+
+    /**
+     * Run the source through detection into the sink until the source ends and every frame is written. The
+     * source runs on a new thread, detection on the calling thread and the sink on another new thread.
+     */
+    PipelineStats run(const Source &source, const Sink &sink);
+
+    /**
+     * Statistics so far, may be called from any thread during run
+     */
+    PipelineStats stats();
+
+    /**
+     * Current depths of the read -> detect and detect -> write queues, from any thread during run
+     */
+    void queue_depths(int &to_detect, int &to_write);
+
+    /**
+     * Source reading the PLY files of paths in order
+     */
+    static Source ply_files(const std::vector<std::string> &paths);
+
+    /**
+     * Sink saving the labels of every frame to frame.path + suffix
+     */
+    static Sink label_files(const std::string &suffix);
+
+private:
+    void record(StageStats &stage, double wait_s, double busy_s, size_t queue_depth);
+
+    PipelineOptions options_;
+    std::vector<PipelineFrame> frames_;
+    SpscQueue<PipelineFrame *> free_, to_detect_, to_write_;
+    std::mutex stats_mutex_;
+    PipelineStats stats_;
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_FRAME_PIPELINE_H
@@ -0,0 +1,105 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_JSON_WRITER_H
+#define POINT_CLOUD_PLANE_DETECTION_JSON_WRITER_H
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace pd {
+
+/**
+ * Minimal streaming JSON writer, enough for flat result records and nested arrays, used for the results of the
+ * benchmarks and of the batch driver
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream &os) : os_(os) {}
+
+    JsonWriter &begin_object(const char *key = nullptr) { return open(key, '{'); }
+
+    JsonWriter &end_object() { return close('}'); }
+
+    JsonWriter &begin_array(const char *key = nullptr) { return open(key, '['); }
+
+    JsonWriter &end_array() { return close(']'); }
+
+    JsonWriter &field(const char *key, const std::string &value) {
+        prefix(key);
+        write_string(value);
+        return *this;
+    }
+
+    JsonWriter &field(const char *key, const char *value) { return field(key, std::string(value)); }
+
+    JsonWriter &field(const char *key, double value) {
+        prefix(key);
+        char buf[32];
+        if (value != value || value - value != 0) sprintf(buf, "null");  // NaN or inf is not valid JSON
+        else sprintf(buf, "%.9g", value);
+        os_ << buf;
+        return *this;
+    }
+
+    JsonWriter &field(const char *key, int value) { return field(key, (long long) value); }
+
+    JsonWriter &field(const char *key, long long value) {
+        prefix(key);
+        os_ << value;
+        return *this;
+    }
+
+    JsonWriter &field(const char *key, bool value) {
+        prefix(key);
+        os_ << (value ? "true" : "false");
+        return *this;
+    }
+
+    JsonWriter &value(double v) { return field(nullptr, v); }
+
+    JsonWriter &value(int v) { return field(nullptr, v); }
+
+private:
+    JsonWriter &open(const char *key, char bracket) {
+        prefix(key);
+        os_ << bracket;
+        first_.push_back(true);
+        return *this;
+    }
+
+    JsonWriter &close(char bracket) {
+        first_.pop_back();
+        os_ << '\n' << std::string(2 * first_.size(), ' ') << bracket;
+        if (first_.empty()) os_ << '\n';
+        return *this;
+    }
+
+    void prefix(const char *key) {
+        if (!first_.empty()) {
+            if (!first_.back()) os_ << ',';
+            first_.back() = false;
+            os_ << '\n' << std::string(2 * first_.size(), ' ');
+        }
+        if (key != nullptr) {
+            write_string(key);
+            os_ << ": ";
+        }
+    }
+
+    void write_string(const std::string &s) {
+        os_ << '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') os_ << '\\' << c;
+            else if (c == '\n') os_ << "\\n";
+            else os_ << c;
+        }
+        os_ << '"';
+    }
+
+    std::ostream &os_;
+    std::vector<bool> first_;
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_JSON_WRITER_H
@@ -0,0 +1,17 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_LINALG_H
+#define POINT_CLOUD_PLANE_DETECTION_LINALG_H
+
+namespace pd {
+
+/**
+ * Eigen decomposition of a symmetric 3 × 3 matrix by cyclic Jacobi rotations
+ *
+ * @param m  Row major symmetric matrix
+ * @param values  Eigenvalues in descending order (output)
+ * @param vectors  Row major, row i is the unit eigenvector of values[i] (output), as cv::eigen
+ */
+void symmetric_eigen3(const double m[9], double values[3], double vectors[9]);
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_LINALG_H
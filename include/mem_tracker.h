@@ -0,0 +1,138 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_MEM_TRACKER_H
+#define POINT_CLOUD_PLANE_DETECTION_MEM_TRACKER_H
+
+#include <cstddef>
+#include <memory>
+
+/*
+ * Allocation accounting.
+ *
+ * When enabled with mem_tracker::set_enabled(true) or PLANE_DETECTION_MEMORY=1, every cv::Mat allocation of the
+ * process goes through a counting allocator (when built with OpenCV), and the arrays, containers and point clouds
+ * of the core report their buffers through new_array / delete_array, ScopedBytes and CountingAllocator. The
+ * profiler then records the bytes allocated and the peak live bytes of every stage.
+ *
+ * live_bytes(), peak_live_bytes() and total_allocated_bytes() count the whole process. Scopes count the thread
+ * that runs them, so stages running at the same time on pool workers, stream runners or server connections do
+ * not disturb each other; the buffers a stage hands to pool workers are counted in the scopes of those workers.
+ */
+namespace mem_tracker {
+
+/**
+ * Enable or disable accounting, enabling installs the counting cv::Mat allocator as the default allocator
+ * when built with OpenCV
+ */
+void set_enabled(bool enabled);
+
+bool enabled();
+
+void on_alloc(size_t bytes);
+
+void on_free(size_t bytes);
+
+/**
+ * Bytes currently allocated and not freed
+ */
+long long live_bytes();
+
+/**
+ * Highest live_bytes() since the last reset
+ */
+long long peak_live_bytes();
+
+/**
+ * Bytes allocated in total since the process started
+ */
+long long total_allocated_bytes();
+
+/**
+ * State saved at the start of a scope, restored by end_scope
+ */
+struct ScopeMark {
+    long long total_at_start, live_at_start, outer_peak;
+};
+
+/**
+ * Start measuring the allocations of the calling thread in a scope, scopes may nest
+ */
+ScopeMark begin_scope();
+
+/**
+ * Finish a scope started with begin_scope
+ *
+ * @param mark  State returned by begin_scope
+ * @param allocated_bytes  Bytes the thread allocated within the scope (output)
+ * @param peak_bytes  Peak of the bytes the thread held above its live bytes at the start of the scope (output)
+ */
+void end_scope(const ScopeMark &mark, long long &allocated_bytes, long long &peak_bytes);
+
+template<typename T>
+T *new_array(size_t n) {
+    T *p = new T[n];
+    if (enabled()) on_alloc(n * sizeof(T));
+    return p;
+}
+
+/**
+ * Free an array from new_array, n must be the size it was allocated with
+ */
+template<typename T>
+void delete_array(T *p, size_t n) {
+    if (enabled()) on_free(n * sizeof(T));
+    delete[] p;
+}
+
+/**
+ * Account for a buffer owned by something else, e.g. a std::vector passed to OpenCV, for the lifetime of the object
+ */
+class ScopedBytes {
+public:
+    explicit ScopedBytes(size_t bytes) : bytes_(enabled() ? bytes : 0) { if (bytes_) on_alloc(bytes_); }
+
+    ~ScopedBytes() { if (bytes_) on_free(bytes_); }
+
+    ScopedBytes(const ScopedBytes &) = delete;
+
+    ScopedBytes &operator=(const ScopedBytes &) = delete;
+
+private:
+    size_t bytes_;
+};
+
+/**
+ * Standard allocator that reports to the tracker, for std containers
+ */
+template<typename T>
+struct CountingAllocator {
+    typedef T value_type;
+
+    CountingAllocator() = default;
+
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        if (enabled()) on_alloc(n * sizeof(T));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, size_t n) {
+        if (enabled()) on_free(n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    struct rebind {
+        typedef CountingAllocator<U> other;
+    };
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &) { return false; }
+
+}  // namespace mem_tracker
+
+#endif //POINT_CLOUD_PLANE_DETECTION_MEM_TRACKER_H
@@ -0,0 +1,85 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_PARALLEL_H
+#define POINT_CLOUD_PLANE_DETECTION_PARALLEL_H
+
+#include <functional>
+
+/*
+ * Parallel loops of the detector. Every parallel_for of the process, from the kernels, VoxelGrid and the I/O of
+ * utils.cpp, runs on one shared work stealing thread pool, so concurrent and nested loops share the same
+ * get_num_threads() threads instead of each spawning their own.
+ *
+ * On multi-socket machines the pool can also keep memory local: with NUMA placement on, every worker is pinned to
+ * the CPUs of one NUMA node, and parallel_for_placed runs each piece of an array on the node its pages were first
+ * touched by, so arrays written and read through it stay in local memory.
+ */
+namespace pd {
+
+/**
+ * CPUs in the affinity mask of the process, the number of hardware threads where there is no affinity mask
+ */
+int available_cpus();
+
+/**
+ * Number of threads a parallel_for runs on, available_cpus() unless set_num_threads was called
+ */
+int get_num_threads();
+
+/**
+ * Set the number of threads of parallel_for, the pool grows to match; 0 or less restores the default
+ */
+void set_num_threads(int num_threads);
+
+/**
+ * Call body on subranges of [begin, end) from up to get_num_threads() threads, the calling thread included,
+ * and return when all of them are done. Subranges are handed out one index at a time, so an index should be a
+ * sizeable piece of work. body may itself call parallel_for; a waiting caller runs queued pool tasks, and blocks
+ * once there are none for a short while. Callers outside the pool count against get_num_threads() while they run,
+ * so loops of several application threads together keep about get_num_threads() threads busy. body must not
+ * throw.
+ */
+void parallel_for(int begin, int end, const std::function<void(int, int)> &body);
+
+/**
+ * Give the pool work started by this thread a deadline until the end of the scope, on any clock where smaller is
+ * more urgent. Idle workers take queued work of threads outside the pool earliest deadline first, and work without
+ * a deadline last, so concurrent detections share the workers in the order their results are due. Pool tasks run
+ * under the deadline of the loop that queued them, which nested loops inherit.
+ */
+class ScopedDeadline {
+public:
+    explicit ScopedDeadline(double deadline);
+
+    ~ScopedDeadline();
+
+    ScopedDeadline(const ScopedDeadline &) = delete;
+
+    ScopedDeadline &operator=(const ScopedDeadline &) = delete;
+
+private:
+    double previous_;
+};
+
+/**
+ * Number of NUMA nodes parallel_for_placed spreads arrays over: the nodes with CPUs in the affinity mask of the
+ * process when NUMA placement is on, else 1
+ */
+int numa_nodes();
+
+/**
+ * Turn NUMA placement on or off, it defaults to on when the environment sets PLANE_DETECTION_NUMA=1. Workers are
+ * pinned to their node when they start, so it should be set before the first parallel loop.
+ */
+void set_numa_placement(bool enabled);
+
+/**
+ * parallel_for over the elements [begin, end) of an array of size elements, in pieces of grain elements starting
+ * at begin, so body(piece_begin, piece_end) gets the same pieces on every call with the same arguments. Element i
+ * belongs to NUMA node i * numa_nodes() / size, and a piece runs on a worker of the node of its first element;
+ * the calling thread only waits. Arrays first written through parallel_for_placed are thus read from local memory
+ * by later calls with the same size. Without NUMA placement this is parallel_for over the pieces.
+ */
+void parallel_for_placed(int begin, int end, int size, int grain, const std::function<void(int, int)> &body);
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_PARALLEL_H
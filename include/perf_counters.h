@@ -0,0 +1,35 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_PERF_COUNTERS_H
+#define POINT_CLOUD_PLANE_DETECTION_PERF_COUNTERS_H
+
+/*
+ * Hardware performance counters of the calling thread, read through Linux perf_event_open.
+ *
+ * Counters that cannot be opened (no permission, not supported by the CPU or the virtual machine, not Linux)
+ * read as -1 and the rest keep working.
+ */
+namespace perf_counters {
+
+enum Counter {
+    CYCLES = 0,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    NUM_COUNTERS
+};
+
+/**
+ * Counter name used in reports
+ */
+const char *name(int counter);
+
+/**
+ * Read the counters of the calling thread, opening them on first use
+ *
+ * @param values  Current counts (output), -1 for counters that are not available
+ * @return  true if at least one counter is available
+ */
+bool read(long long values[NUM_COUNTERS]);
+
+}  // namespace perf_counters
+
+#endif //POINT_CLOUD_PLANE_DETECTION_PERF_COUNTERS_H
@@ -0,0 +1,121 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_PLANE_DETECTION_H
+#define POINT_CLOUD_PLANE_DETECTION_PLANE_DETECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface of the plane detector, for callers that cannot cross a C++ / OpenCV boundary.
+ *
+ * The point cloud is read in place from caller owned memory: point i is the three floats at
+ * (const char *) xyz + i * stride. Labels and planes are written to caller owned buffers. No function throws;
+ * failures are reported through the returned pd_status and pd_last_error().
+ */
+
+#if defined(_WIN32) && defined(PLANE_DETECTION_SHARED)
+#  ifdef PLANE_DETECTION_BUILDING
+#    define PD_API __declspec(dllexport)
+#  else
+#    define PD_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define PD_API __attribute__((visibility("default")))
+#else
+#  define PD_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum pd_status {
+    PD_OK = 0,
+    PD_ERROR_INVALID_ARGUMENT = 1,
+    PD_ERROR_OUT_OF_MEMORY = 2,
+    PD_ERROR_INTERNAL = 3
+} pd_status;
+
+/*
+ * How the planes of the (downsampled) cloud are searched
+ */
+typedef enum pd_search {
+    PD_SEARCH_RANSAC = 0,                 /* RANSAC over random triplets, with or without a normal constraint */
+    PD_SEARCH_PROJECTION = 1,             /* Densest slab of the projections onto normal, needs use_normal */
+    PD_SEARCH_MANHATTAN = 2               /* Densest slabs along three orthogonal dominant directions, the first one
+                                             is normal with use_normal */
+} pd_search;
+
+/*
+ * Version of pd_params of this header. Fields are only ever appended to pd_params, and every append raises the
+ * version.
+ */
+#define PD_PARAMS_VERSION 3
+
+/*
+ * Detection parameters, see get_planes in ransac.h. Always initialize them with pd_default_params: it records the
+ * PD_PARAMS_VERSION the caller was compiled with in version, and the library only reads and writes the fields of
+ * that version, so a caller built against an older header keeps working with a newer library.
+ */
+typedef struct pd_params {
+    uint32_t version;                     /* PD_PARAMS_VERSION of the caller, set by pd_default_params */
+    float threshold;                      /* Distance threshold of an inlier */
+    int max_iterations;                   /* Maximum number of RANSAC iterations per plane */
+    int desired_num_planes;               /* Number of target planes */
+    float grid_size;                      /* Downsampling grid size, <= 0 means no downsampling */
+    int use_normal;                       /* Non zero to constrain the plane normal to normal */
+    float normal[3];                      /* Normal vector constraint */
+    double normal_diff_thr;               /* Tolerance of the normal vector constraint */
+    /* Version 2 */
+    int weighted;                         /* Non zero to score downsampled points by the points of their voxel */
+    /* Version 3 */
+    int search;                           /* pd_search */
+} pd_params;
+
+/**
+ * Fill the fields of a pd_params of the given version with the defaults of get_planes: one plane, no
+ * downsampling, no normal constraint. Call it through pd_default_params.
+ */
+PD_API void pd_init_params(pd_params *params, uint32_t version);
+
+/**
+ * Fill params with the defaults, for the pd_params of the header the caller is compiled with
+ */
+static inline void pd_default_params(pd_params *params) {
+    pd_init_params(params, PD_PARAMS_VERSION);
+}
+
+/**
+ * Detect planes in a point cloud
+ *
+ * @param xyz  First point, three consecutive floats x, y, z
+ * @param n  Number of points, at least 3
+ * @param stride  Distance in bytes between consecutive points, a multiple of sizeof(float) and at least
+ *                3 * sizeof(float); 0 means tightly packed. Packed points are used without a copy, points with a
+ *                larger stride are first copied into a packed buffer of n * 3 floats
+ * @param params  Detection parameters initialized with pd_default_params, NULL for the defaults
+ * @param labels  n labels (output), 0 for points of no plane, otherwise the 1-based index of the plane in planes:
+ *                the points of label k are the inliers of plane k - 1. May be NULL
+ * @param planes  Plane equations a, b, c, d of ax + by + cz + d = 0, 4 floats per plane, in descending order of
+ *                inliers (output)
+ * @param planes_capacity  Number of planes that fit in planes, at least params->desired_num_planes
+ * @param num_planes  Number of planes written to planes (output), may be NULL
+ * @return PD_OK, or the reason of the failure, in which case the outputs are unspecified
+ */
+PD_API pd_status pd_get_planes(const float *xyz, size_t n, size_t stride, const pd_params *params,
+                               int32_t *labels, float *planes, size_t planes_capacity, size_t *num_planes);
+
+/**
+ * Message of the last failure of a call on this thread, empty after a successful call
+ */
+PD_API const char *pd_last_error(void);
+
+/**
+ * Name of a status code
+ */
+PD_API const char *pd_status_string(pd_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //POINT_CLOUD_PLANE_DETECTION_PLANE_DETECTION_H
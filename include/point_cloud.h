@@ -0,0 +1,145 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_POINT_CLOUD_H
+#define POINT_CLOUD_PLANE_DETECTION_POINT_CLOUD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "mem_tracker.h"
+
+/*
+ * Minimal types of the detection core, so that ransac.cpp builds without OpenCV.
+ */
+namespace pd {
+
+/**
+ * Fixed size vector, indexed like cv::Vec
+ */
+template<typename T, int n>
+struct Vec {
+    T val[n];
+
+    Vec() : val() {}
+
+    Vec(T v0, T v1, T v2) : val{v0, v1, v2} { static_assert(n == 3, "Vec of 3 elements"); }
+
+    Vec(T v0, T v1, T v2, T v3) : val{v0, v1, v2, v3} { static_assert(n == 4, "Vec of 4 elements"); }
+
+    T &operator[](int i) { return val[i]; }
+
+    const T &operator[](int i) const { return val[i]; }
+
+    T &operator()(int i) { return val[i]; }
+
+    const T &operator()(int i) const { return val[i]; }
+
+    T dot(const Vec &o) const {
+        T s = 0;
+        for (int i = 0; i < n; ++i) s += val[i] * o.val[i];
+        return s;
+    }
+};
+
+typedef Vec<float, 3> Vec3f;
+typedef Vec<float, 4> Vec4f;
+
+/**
+ * Read only view of n packed x, y, z points of scalar type T, what the kernels of ransac_kernels.h take.
+ * Coordinate k of point i is offset[k] + scale[k] * data[3 * i + k], so integer types hold quantised points;
+ * floating point views keep the identity.
+ */
+template<typename T>
+struct PointSpan {
+    const T *data;
+    int size;
+    double scale[3], offset[3];
+
+    PointSpan(const T *data, int size) : data(data), size(size), scale{1, 1, 1}, offset{0, 0, 0} {}
+};
+
+/**
+ * Packed x, y, z float points, either owned or a view of memory owned by the caller.
+ *
+ * Copies share the buffer like cv::Mat headers; clone() makes a deep copy. Owned buffers are reported to
+ * mem_tracker and left uninitialized, so their pages are first touched, and placed on a NUMA node, by whichever
+ * thread writes them first.
+ */
+class PointCloud {
+public:
+    PointCloud() : data_(nullptr), size_(0) {}
+
+    /**
+     * Owned cloud of size uninitialized points
+     */
+    explicit PointCloud(int size)
+            : storage_(mem_tracker::new_array<float>((size_t) size * 3), ArrayDeleter{(size_t) size * 3}),
+              data_(storage_.get()), size_(size) {}
+
+    /**
+     * View of size packed points at data, which must outlive the cloud and every copy of it
+     */
+    PointCloud(const float *data, int size) : data_(const_cast<float *>(data)), size_(size) {}
+
+    int size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    float *data() { return data_; }
+
+    const float *data() const { return data_; }
+
+    float *point(int i) { return data_ + 3 * (size_t) i; }
+
+    const float *point(int i) const { return data_ + 3 * (size_t) i; }
+
+    PointSpan<float> span() const { return PointSpan<float>(data_, size_); }
+
+    PointCloud clone() const {
+        PointCloud copy(size_);
+        std::copy(data_, data_ + 3 * (size_t) size_, copy.data_);
+        return copy;
+    }
+
+private:
+    struct ArrayDeleter {
+        size_t n;
+
+        void operator()(float *p) const { mem_tracker::delete_array(p, n); }
+    };
+
+    std::shared_ptr<float> storage_;
+    float *data_;
+    int size_;
+};
+
+/**
+ * Quantise a cloud to 16 bit integers over its bounding box, the error is at most half a step of
+ * (max - min) / 65535 per axis, so the inlier threshold should be well above it
+ *
+ * @param pts  Points to quantise
+ * @param storage  Holds the quantised points (output), the returned view is valid while storage is unchanged
+ */
+inline PointSpan<int16_t> quantise(const PointCloud &pts, std::vector<int16_t> &storage) {
+    const int size = pts.size();
+    storage.resize(3 * (size_t) size);
+    PointSpan<int16_t> span(storage.data(), size);
+    for (int k = 0; k < 3; ++k) {
+        float min = size > 0 ? pts.data()[k] : 0, max = min;
+        for (int i = 1; i < size; ++i) {
+            min = std::min(min, pts.point(i)[k]);
+            max = std::max(max, pts.point(i)[k]);
+        }
+        span.scale[k] = max > min ? ((double) max - min) / 65535 : 1;
+        span.offset[k] = min + 32768 * span.scale[k];
+        for (int i = 0; i < size; ++i) {
+            long q = std::lround((pts.point(i)[k] - span.offset[k]) / span.scale[k]);
+            storage[3 * (size_t) i + k] = (int16_t) std::max(-32768L, std::min(32767L, q));
+        }
+    }
+    return span;
+}
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_POINT_CLOUD_H
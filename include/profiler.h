@@ -0,0 +1,143 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_PROFILER_H
+#define POINT_CLOUD_PLANE_DETECTION_PROFILER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "mem_tracker.h"
+#include "perf_counters.h"
+
+/*
+ * Stage timing instrumentation.
+ *
+ * PD_PROFILE_SCOPE(name) / PD_PROFILE_SCOPE_INDEX(name, index) time the enclosing scope with std::chrono::steady_clock.
+ * They compile to nothing unless PLANE_DETECTION_PROFILING is defined, and record nothing unless profiling is
+ * enabled at runtime with profiler::set_enabled(true) or the PLANE_DETECTION_PROFILE=1 environment variable.
+ * Every thread appends to its own record buffer, so the report must be read when no scope is active. A buffer
+ * keeps the latest max_records() records of its thread (PLANE_DETECTION_PROFILE_RECORDS, default 65536); the
+ * records of exited threads share one more buffer of that size.
+ *
+ * The records can be exported as a Chrome trace (chrome://tracing, ui.perfetto.dev) with write_chrome_trace().
+ * Setting PLANE_DETECTION_TRACE=<path> enables profiling and writes the trace to <path> at process exit.
+ *
+ * With set_counters_enabled(true) or PLANE_DETECTION_PERF=1 every scope also records the hardware counters of
+ * its thread (see perf_counters.h), reported next to the timings. With allocation accounting enabled (see
+ * mem_tracker.h) every scope records the bytes its thread allocated and the peak bytes it held while it ran.
+ * Both only cover the thread of the scope: the work a stage hands to pool workers through parallel_for, e.g. in
+ * get_inliers, VoxelGrid and remove_inliers, is missing from its counters and bytes.
+ */
+namespace profiler {
+
+/**
+ * One timed scope
+ */
+struct StageRecord {
+    const char *name;   // Stage name, a string literal
+    int index;          // Stage instance, e.g. the plane number, -1 if not applicable
+    int thread;         // Sequential id of the thread that ran the stage
+    double start_s;     // Start time relative to the profiler epoch
+    double duration_s;
+    long long counters[perf_counters::NUM_COUNTERS];  // Hardware counter deltas, -1 if not available
+    long long allocated_bytes;  // Bytes allocated within the stage, -1 without allocation accounting
+    long long peak_bytes;       // Peak bytes the stage held above its start, -1 without allocation accounting
+};
+
+/**
+ * Per stage counters aggregated over all threads
+ */
+struct StageStats {
+    std::string name;
+    long long calls;
+    double total_s, min_s, max_s;
+    long long counters[perf_counters::NUM_COUNTERS];  // Summed hardware counter deltas, -1 if not available
+    long long allocated_bytes;  // Summed, -1 without allocation accounting
+    long long peak_bytes;       // Maximum over all calls, -1 without allocation accounting
+};
+
+/**
+ * Wall clock seconds since the profiler epoch (steady clock)
+ */
+double now_s();
+
+void set_enabled(bool enabled);
+
+bool enabled();
+
+void set_counters_enabled(bool enabled);
+
+bool counters_enabled();
+
+/**
+ * Records kept per thread, older records are overwritten
+ */
+void set_max_records(size_t records);
+
+size_t max_records();
+
+/**
+ * Records overwritten since the last reset
+ */
+long long dropped_records();
+
+/**
+ * Drop all records of all threads
+ */
+void reset();
+
+/**
+ * All records of all threads, ordered by start time
+ */
+std::vector<StageRecord> records();
+
+/**
+ * Records aggregated by stage name, in order of first appearance
+ */
+std::vector<StageStats> stage_stats();
+
+/**
+ * Print stage_stats() as a table
+ */
+void print_report(FILE *out = stdout);
+
+/**
+ * Write all records as complete events ("ph": "X") in the Chrome JSON trace format
+ *
+ * @param file_path  Output path
+ * @return  true or false
+ */
+bool write_chrome_trace(const std::string &file_path);
+
+class ScopedStage {
+public:
+    explicit ScopedStage(const char *name, int index = -1);
+
+    ~ScopedStage();
+
+    ScopedStage(const ScopedStage &) = delete;
+
+    ScopedStage &operator=(const ScopedStage &) = delete;
+
+private:
+    const char *name_;
+    int index_;
+    double start_s_;
+    long long counters_start_[perf_counters::NUM_COUNTERS];
+    mem_tracker::ScopeMark mem_mark_;
+    bool active_, counting_, tracking_;
+};
+
+}  // namespace profiler
+
+#define PD_PROFILE_CONCAT_(a, b) a##b
+#define PD_PROFILE_CONCAT(a, b) PD_PROFILE_CONCAT_(a, b)
+
+#ifdef PLANE_DETECTION_PROFILING
+#define PD_PROFILE_SCOPE(name) profiler::ScopedStage PD_PROFILE_CONCAT(pd_profile_scope_, __LINE__)(name)
+#define PD_PROFILE_SCOPE_INDEX(name, index) \
+    profiler::ScopedStage PD_PROFILE_CONCAT(pd_profile_scope_, __LINE__)(name, index)
+#else
+#define PD_PROFILE_SCOPE(name) do {} while (0)
+#define PD_PROFILE_SCOPE_INDEX(name, index) do {} while (0)
+#endif
+
+#endif //POINT_CLOUD_PLANE_DETECTION_PROFILER_H
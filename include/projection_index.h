@@ -0,0 +1,100 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_PROJECTION_INDEX_H
+#define POINT_CLOUD_PLANE_DETECTION_PROJECTION_INDEX_H
+
+#include <vector>
+#include "point_cloud.h"
+
+/*
+ * Index of a point cloud for planes of one known normal. The points are sorted by their projection h = n·p onto the
+ * unit normal n, so the points of the plane n·p + d = 0 within thr are one contiguous range, found with two binary
+ * searches, and a Fenwick tree over the sorted points sums their weights in O(log n).
+ *
+ * Planes whose normal m deviates from n, as allowed by a normal constraint, still only reach a band of projections:
+ * |m·p + d| < thr implies |n·p - c| < thr + |m - n| r, with r the radius of the cloud around its centroid, so
+ * their inliers are counted exactly by testing the points of that band rather than the whole cloud.
+ *
+ * Points of found planes are removed from the index instead of compacting the cloud, indices stay those of the cloud.
+ */
+namespace pd {
+
+class ProjectionIndex {
+public:
+    /**
+     * @param pts  Point cloud, must outlive the index
+     * @param normal  Direction to project onto, of any length
+     * @param weights  Weight of every point, nullptr for 1; counts are summed weights
+     */
+    ProjectionIndex(const PointCloud &pts, const Vec3f &normal, const int *weights = nullptr);
+
+    const PointCloud &points() const { return pts_; }
+
+    /**
+     * Unit normal of the index
+     */
+    const Vec3f &normal() const { return normal_; }
+
+    /**
+     * Summed weight of the points not removed
+     */
+    int remaining() const { return prefix(size()); }
+
+    /**
+     * Summed weight of the remaining points with |n·p - offset| < thr, in O(log n)
+     */
+    int count(double offset, double thr) const;
+
+    /**
+     * The densest slab of the remaining points across the normal, in one pass over the sorted points
+     *
+     * @param thr  Half width of the slab
+     * @param offset  Weighted median projection of the slab (output), the plane is n·p - offset = 0
+     * @return summed weight of the slab, 0 when no point remains
+     */
+    int densest(double thr, double &offset) const;
+
+    /**
+     * Upper bound of inliers(model, thr), in O(log n)
+     */
+    int bound(const Vec4f &model, float thr) const;
+
+    /**
+     * Exact inliers |m·p + d| < thr among the remaining points, only the band of projections the plane can reach
+     * is tested
+     *
+     * @param model  Plane a, b, c, d, its normal should be close to normal()
+     * @param points  Indices in points() of the inliers (output)
+     * @param touched  Number of points tested (output), nullptr to skip
+     * @return summed weight of the inliers
+     */
+    int inliers(const Vec4f &model, float thr, std::vector<int> &points, long long *touched = nullptr) const;
+
+    /**
+     * Remove points, by their indices in points(), from every later query
+     */
+    void remove(const std::vector<int> &points);
+
+private:
+    int size() const { return (int) order_.size(); }
+
+    // Summed weight of the remaining points at sorted positions [0, end)
+    int prefix(int end) const;
+
+    // Sorted positions [first, last) with projections strictly within half of centre
+    void range(double centre, double half, int &first, int &last) const;
+
+    // Projection range a plane near normal() can reach with inliers within thr
+    void band(const Vec4f &model, float thr, double &centre, double &half) const;
+
+    PointCloud pts_;
+    Vec3f normal_;
+    double centroid_[3], radius_;
+    std::vector<float> projection_;  // Sorted projections
+    std::vector<int> order_;         // Point at every sorted position
+    std::vector<int> position_;      // Sorted position of every point
+    std::vector<int> weight_;        // Weight at every sorted position, 0 once removed
+    std::vector<int> tree_;          // Fenwick tree over weight_
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_PROJECTION_INDEX_H
@@ -0,0 +1,47 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_RANDOM_H
+#define POINT_CLOUD_PLANE_DETECTION_RANDOM_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace pd {
+
+/**
+ * Multiply with carry generator, the same sequence as cv::RNG for the same state
+ */
+class Rng {
+public:
+    explicit Rng(uint64_t state = 0xffffffff) : state_(state ? state : 0xffffffff) {}
+
+    unsigned next() {
+        state_ = (uint64_t) (unsigned) state_ * 4164903690U + (unsigned) (state_ >> 32);
+        return (unsigned) state_;
+    }
+
+    /**
+     * Uniform integer in [a, b)
+     */
+    int uniform(int a, int b) {
+        return a == b ? a : (int) (next() % (unsigned) (b - a) + a);
+    }
+
+private:
+    uint64_t state_;
+};
+
+/**
+ * Fisher-Yates shuffle, as cv::randShuffle
+ */
+template<typename T, typename Alloc>
+void shuffle(std::vector<T, Alloc> &v, Rng &rng) {
+    const unsigned size = (unsigned) v.size();
+    for (unsigned i = 0; i + 1 < size; ++i) {
+        unsigned j = rng.next() % (size - i) + i;
+        std::swap(v[i], v[j]);
+    }
+}
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_RANDOM_H
@@ -1,16 +1,94 @@
 #ifndef POINT_CLOUD_PLANE_DETECTION_RANSAC_H
 #define POINT_CLOUD_PLANE_DETECTION_RANSAC_H
 
-#include <opencv2/opencv.hpp>
+#include <vector>
+#include "plane_detection.h"
+#include "point_cloud.h"
+#include "projection_index.h"
 
-bool total_least_squares_plane_estimate(cv::Vec4f &model, const cv::Mat &input, const int *sample, int sample_num);
+// Work counters of one get_planes call, the kernels only ever add to them
+struct RansacStats {
+    long long hypotheses = 0;           // Minimal samples drawn in get_plane
+    long long degenerate = 0;           // Hypotheses rejected because the sample is degenerate
+    long long normal_rejected = 0;      // Hypotheses rejected by the normal constraint
+    long long inlier_passes = 0;        // get_inliers passes over all points
+    long long early_terminations = 0;   // get_inliers passes cut short by pruning
+    long long lo_improvements = 0;      // Local optimisation steps that found more inliers
+    long long points_touched = 0;       // Point to plane distances evaluated
+    std::vector<int> iteration_bounds;  // Final adaptive iteration bound of every get_plane call
+};
 
-int get_inliers(bool *inliers, const cv::Vec4f &model, const cv::Mat &pts, float thr, int best_inls = 0);
+bool total_least_squares_plane_estimate(pd::Vec4f &model, const pd::PointCloud &input, const int *sample,
+                                        int sample_num);
 
-bool VoxelGrid(cv::Mat &sampling_pts, cv::Mat &pts, float length, float width, float height);
+int get_inliers(bool *inliers, const pd::Vec4f &model, const pd::PointCloud &pts, float thr, int best_inls = 0,
+                RansacStats *stats = nullptr);
 
-void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray &points3d,
+/**
+ * @param weights  Weight of every point, nullptr for 1; the result is then the summed weight of the inliers
+ */
+int get_plane(pd::Vec4f &best_model, bool *inliers, const pd::PointCloud &pts, float thr, int max_iterations,
+              const pd::Vec3f *normal, double normal_diff_thr, RansacStats *stats = nullptr,
+              const int *weights = nullptr);
+
+/**
+ * Plane within the normal constraint through the densest slab 2 thr wide of the remaining points of index. Total
+ * least squares fits on its inliers then correct the tilt; the refits are bounded and counted through the index, so
+ * no step scans the whole cloud
+ *
+ * @param inliers  Indices of the inliers in index.points() (output)
+ * @return summed weight of the inliers
+ */
+int get_plane_indexed(pd::Vec4f &best_model, std::vector<int> &inliers, const pd::ProjectionIndex &index, float thr,
+                      double normal_diff_thr, RansacStats *stats = nullptr);
+
+/**
+ * Dominant orthogonal directions of a Manhattan world scene, from the normals of two RANSAC planes: the largest
+ * plane (or normal when given), then the largest plane perpendicular to it; the third is their cross product
+ *
+ * @param directions  Unit directions, the first num of them are set (output)
+ * @param weights  Weight of every point, nullptr for 1
+ * @return num, 3, 1 when no plane is perpendicular to the first direction, 0 when no plane is found
+ */
+int manhattan_directions(pd::Vec3f directions[3], const pd::PointCloud &pts, float thr, int max_iterations,
+                         const pd::Vec3f *normal, double normal_diff_thr, RansacStats *stats = nullptr,
+                         const int *weights = nullptr);
+
+/**
+ * @param counts  Number of points of pts in the voxel of every sample (output), nullptr to skip
+ */
+bool VoxelGrid(pd::PointCloud &sampling_pts, const pd::PointCloud &pts, float length, float width, float height,
+               std::vector<int> *counts = nullptr);
+
+/**
+ * Get multiple planes, see ransac_opencv.h for the cv::Mat interface
+ *
+ * @param labels  n labels (output), n is the size of points3d
+ */
+void get_planes(int *labels, std::vector<pd::Vec4f> &planes, const pd::PointCloud &points3d,
                 float thr, int max_iterations, int desired_num_planes = 1, float grid_size = -1,
-                cv::Vec3f *normal = nullptr, double normal_diff_thr = 0.06);
+                const pd::Vec3f *normal = nullptr, double normal_diff_thr = 0.06, RansacStats *stats = nullptr,
+                bool weighted = false, pd_search search = PD_SEARCH_RANSAC);
+
+/**
+ * Print the progress of get_planes to stdout when built with INFO, on by default. The output of detections running
+ * at the same time interleaves, so drivers that run several turn it off.
+ */
+void set_print_progress(bool enabled);
+
+/**
+ * Turns the progress of get_planes off on the calling thread while it lives, for drivers that detect frame after
+ * frame and measure how long it takes
+ */
+class QuietProgress {
+public:
+    QuietProgress();
+
+    ~QuietProgress();
+
+    QuietProgress(const QuietProgress &) = delete;
+
+    QuietProgress &operator=(const QuietProgress &) = delete;
+};
 
 #endif //POINT_CLOUD_PLANE_DETECTION_RANSAC_H
@@ -0,0 +1,431 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_RANSAC_KERNELS_H
+#define POINT_CLOUD_PLANE_DETECTION_RANSAC_KERNELS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "linalg.h"
+#include "mem_tracker.h"
+#include "parallel.h"
+#include "point_cloud.h"
+#include "profiler.h"
+#include "random.h"
+#include "ransac.h"
+
+/*
+ * Header only RANSAC kernels, templated on the scalar type of the points (float, double or quantised int16_t,
+ * see PointSpan) and on compile time policies, so every configuration gets its own loops without run time checks:
+ *
+ *   Prune       Pruning / NoPruning, whether get_inliers may stop once a model cannot beat best_inls
+ *   Constraint  NoNormalConstraint / NormalConstraint, the test a hypothesis must pass before it is scored
+ *   Sampler     UniformSampler / DistinctSampler, how the minimal sample of get_plane is drawn
+ *   Weights     Unweighted / PointWeights, whether a hypothesis scores its number of inliers or their summed weight
+ *
+ * get_plane is RANSAC over random triplets. The projection search does without sampling, see projection_index.h.
+ *
+ * Models are computed in ScalarTraits<T>::compute_type, float for float and int16_t points, double for double.
+ * The functions of ransac.h are the float instantiations used by get_planes.
+ */
+namespace pd {
+
+template<typename T>
+struct ScalarTraits {
+    typedef T compute_type;
+};
+
+template<>
+struct ScalarTraits<int16_t> {
+    typedef float compute_type;
+};
+
+// Below this many points a parallel get_inliers pass costs more than it saves
+const int parallel_min_points = 1 << 16;
+
+struct Pruning {
+    static const bool enabled = true;
+};
+
+struct NoPruning {
+    static const bool enabled = false;
+};
+
+/**
+ * Every point counts once, the score of a model is its number of inliers
+ */
+struct Unweighted {
+    int operator()(int) const { return 1; }
+
+    // Weight of the points p.. of a cloud of size points
+    int remaining(int p, int size) const { return size - p; }
+};
+
+/**
+ * Every point counts its weight, such as the number of points of the voxel a downsampled point stands for, and the
+ * score of a model is the summed weight of its inliers
+ */
+struct PointWeights {
+    const int *weight;  // Weight of every point
+    const int *tail;    // tail[p] is the summed weight of the points p.. to the end, size + 1 entries
+
+    int operator()(int p) const { return weight[p]; }
+
+    int remaining(int p, int) const { return tail[p]; }
+};
+
+/**
+ * Check whether the normal of a plane is close to the expected normal
+ *
+ * @param thr  Tolerance, compared with (a·b² - |a|²|b|²)² / (|a|²|b|²)
+ */
+// 其实就是求解两个向量的夹角，当夹角小于给定阈值 则认为估计的平面法向与预计法向接近 预设的thr=0.06
+template<typename C>
+bool same_normal(const Vec<C, 4> &actual_plane, const Vec3f &expect_normal, double thr) {
+    double dot = (actual_plane[0] * expect_normal[0] + actual_plane[1] * expect_normal[1] +
+                  actual_plane[2] * expect_normal[2]);
+    double sqr_modulu_a = (actual_plane[0] * actual_plane[0] + actual_plane[1] * actual_plane[1] +
+                           actual_plane[2] * actual_plane[2]);
+    double sqr_modulu_b = (expect_normal[0] * expect_normal[0] + expect_normal[1] * expect_normal[1] +
+                           expect_normal[2] * expect_normal[2]);
+    double cos_sqr = dot * dot;
+    double sqr_modulu_ab = (sqr_modulu_a * sqr_modulu_b);  // 如果都为单位向量 则两个向量模长都为1
+    return (cos_sqr - sqr_modulu_ab) * (cos_sqr - sqr_modulu_ab) <= thr * sqr_modulu_ab;
+}
+
+struct NoNormalConstraint {
+    template<typename C>
+    bool accept(const Vec<C, 4> &) const { return true; }
+};
+
+struct NormalConstraint {
+    Vec3f normal;
+    double thr;
+
+    NormalConstraint(const Vec3f &normal, double thr) : normal(normal), thr(thr) {}
+
+    template<typename C>
+    bool accept(const Vec<C, 4> &plane) const { return same_normal(plane, normal, thr); }
+};
+
+/**
+ * Plane normals perpendicular to axis, such as walls to a floor normal; thr is the tolerance of same_normal
+ */
+struct PerpendicularConstraint {
+    Vec3f axis;
+    double thr;
+
+    PerpendicularConstraint(const Vec3f &axis, double thr) : axis(axis), thr(thr) {}
+
+    template<typename C>
+    bool accept(const Vec<C, 4> &plane) const {
+        double dot = plane[0] * axis[0] + plane[1] * axis[1] + plane[2] * axis[2];
+        double sqr_modulu_ab = (plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]) *
+                               (axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        return dot * dot * dot * dot <= thr * sqr_modulu_ab * sqr_modulu_ab;
+    }
+};
+
+/**
+ * Independent uniform indices, a sample may repeat a point and is then rejected as degenerate
+ */
+class UniformSampler {
+public:
+    explicit UniformSampler(uint64_t seed = 0xffffffff) : rng_(seed) {}
+
+    void sample(int *out, int sample_size, int pts_size) {
+        for (int i = 0; i < sample_size; ++i) out[i] = rng_.uniform(0, pts_size);
+    }
+
+    Rng &rng() { return rng_; }
+
+private:
+    Rng rng_;
+};
+
+/**
+ * Uniform indices without repetition, pts_size must be at least sample_size
+ */
+class DistinctSampler {
+public:
+    explicit DistinctSampler(uint64_t seed = 0xffffffff) : rng_(seed) {}
+
+    void sample(int *out, int sample_size, int pts_size) {
+        for (int i = 0; i < sample_size; ++i) {
+            int p;
+            do p = rng_.uniform(0, pts_size); while (std::find(out, out + i, p) != out + i);
+            out[i] = p;
+        }
+    }
+
+    Rng &rng() { return rng_; }
+
+private:
+    Rng rng_;
+};
+
+/**
+ * Get points in the plane
+ *
+ * @param inliers  Mark whether it is the inner point of the input plane (output)
+ *
+ * @param model  Plane model
+ * @param pts  Point cloud
+ * @param thr  Threshold, the point is considered to belong to the plane if the distance from the point to the plane is less than the threshold
+ * @param best_inls  The number of interior points of the best model. With Pruning, if there is no chance that the number of interior points is greater than this value, the calculation will be terminated
+ * @param stats  Run statistics to add to, nullptr to skip
+ * @param weights  Weight of every point, Unweighted or PointWeights
+ * @return number of points, their summed weight with PointWeights
+ */
+// 这里有一个剪枝策略 就是先计算2/3的点数 对于后1/3的点当前平面内点数+未遍历点数<最佳平面点数 则该平面不是最佳平面 可忽略
+template<typename Prune, typename T, typename Weights = Unweighted>
+int get_inliers(bool *inliers, const Vec<typename ScalarTraits<T>::compute_type, 4> &model, const PointSpan<T> &pts,
+                float thr, int best_inls = 0, RansacStats *stats = nullptr, const Weights &weights = Weights()) {
+    typedef typename ScalarTraits<T>::compute_type C;
+    const int pts_size = pts.size;
+    const T *pts_ptr = pts.data;
+    C a = model(0), b = model(1), c = model(2), d = model(3), hom = std::sqrt(a * a + b * b + c * c);
+    a = a / hom, b = b / hom, c = c / hom, d = d / hom;
+    // Fold the dequantisation into the plane, a (offset + scale q) = a scale q + a offset; identity for floats
+    d += (C) (a * pts.offset[0] + b * pts.offset[1] + c * pts.offset[2]);
+    a = (C) (a * pts.scale[0]), b = (C) (b * pts.scale[1]), c = (C) (c * pts.scale[2]);
+    const C t = thr;
+
+    int num_inliers = 0;
+
+    // According to statistical estimation, the calculation of the first 2/3 of the points is necessary and cannot be pruned
+    // Without a best model there is nothing to prune against and the whole pass is unconditional
+    int cut = Prune::enabled && best_inls > 0 ? pts_size * 2 / 3 : pts_size;
+    if (cut >= parallel_min_points && get_num_threads() > 1) {
+        // Count the unconditional part in parallel pieces, each on the NUMA node that holds its points
+        std::atomic<int> parallel_inliers(0);
+        const int grain = std::max(parallel_min_points / 4, cut / (get_num_threads() * 4));
+        parallel_for_placed(0, cut, pts_size, grain, [&](int begin, int end) {
+            std::fill(inliers + begin, inliers + end, false);
+            int cnt = 0;
+            for (int p = begin; p < end; ++p) {
+                int pp = 3 * p;
+                if (std::fabs(a * (C) pts_ptr[pp] + b * (C) pts_ptr[pp + 1] + c * (C) pts_ptr[pp + 2] + d) < t) {
+                    inliers[p] = true;
+                    cnt += weights(p);
+                }
+            }
+            parallel_inliers += cnt;
+        });
+        num_inliers = parallel_inliers;
+        std::fill(inliers + cut, inliers + pts_size, false);
+    } else {
+        std::fill(inliers, inliers + pts_size, false);
+        for (int p = 0; p < cut; ++p) {
+            int pp = 3 * p;
+            if (std::fabs(a * (C) pts_ptr[pp] + b * (C) pts_ptr[pp + 1] + c * (C) pts_ptr[pp + 2] + d) < t) {
+                inliers[p] = true;
+                num_inliers += weights(p);
+            }
+        }
+    }
+    // prune
+    int p = cut;
+    if (Prune::enabled) {
+        for (; p < pts_size; ++p) {
+            int pp = 3 * p;
+            if (std::fabs(a * (C) pts_ptr[pp] + b * (C) pts_ptr[pp + 1] + c * (C) pts_ptr[pp + 2] + d) < t) {
+                inliers[p] = true;
+                num_inliers += weights(p);
+            }
+            // If the uncalculated points are all interior points and the model cannot be better than the best model, then terminate the calculation
+            if (num_inliers + weights.remaining(p, pts_size) < best_inls) break;
+        }
+    }
+
+    if (stats != nullptr) {
+        if (p < pts_size) {
+            ++stats->early_terminations;
+            stats->points_touched += p + 1;
+        } else {
+            ++stats->inlier_passes;
+            stats->points_touched += pts_size;
+        }
+    }
+    return num_inliers;
+}
+
+/**
+ * Select some points to fit a plane
+ *
+ * @param model  Fitted plane model results (output) ax + by + cz + d = 0
+ *
+ * @param input  Input point cloud
+ * @param sample  The point used to fit the plane is the data subscript in the input, the first sample_num is valid
+ * @param sample_num  The number of points used to fit the plane
+ * @return is the fitting result valid
+ */
+// 最佳拟合平面使用最小二乘特征值分解的方法求解
+// 具体是总体最小二乘法(Total Least Square, TLS)可求解特殊平面
+template<typename T>
+bool total_least_squares_plane_estimate(Vec<typename ScalarTraits<T>::compute_type, 4> &model,
+                                        const PointSpan<T> &input, const int *sample, int sample_num) {
+    typedef typename ScalarTraits<T>::compute_type C;
+    const T *pts_ptr = input.data;
+    auto coord = [&](int p, int k) -> C { return (C) (input.offset[k] + input.scale[k] * pts_ptr[3 * p + k]); };
+
+    // Judging the collinearity of three points
+    if (3 == sample_num) {
+        Vec<C, 3> ba(coord(sample[0], 0) - coord(sample[1], 0), coord(sample[0], 1) - coord(sample[1], 1),
+                     coord(sample[0], 2) - coord(sample[1], 2));
+        Vec<C, 3> ca(coord(sample[0], 0) - coord(sample[2], 0), coord(sample[0], 1) - coord(sample[2], 1),
+                     coord(sample[0], 2) - coord(sample[2], 2));
+        C ba_dot_ca = std::fabs(ca.dot(ba));
+        if (std::fabs(ba_dot_ca * ba_dot_ca - ba.dot(ba) * ca.dot(ca)) < 0.0001) {
+            return false;
+        }
+    }
+    C sum_x = 0, sum_y = 0, sum_z = 0;
+    for (int i = 0; i < sample_num; ++i) {
+        sum_x += coord(sample[i], 0);
+        sum_y += coord(sample[i], 1);
+        sum_z += coord(sample[i], 2);
+    }
+
+    const C mean_x = sum_x / sample_num, mean_y = sum_y / sample_num, mean_z = sum_z / sample_num;
+
+    // Scatter matrix U^T * U of the centered sample
+    double pd_mat[9] = {0};
+    for (int i = 0; i < sample_num; ++i) {
+        double u[3] = {coord(sample[i], 0) - mean_x, coord(sample[i], 1) - mean_y, coord(sample[i], 2) - mean_z};
+        for (int r = 0; r < 3; ++r)
+            for (int c = r; c < 3; ++c) pd_mat[3 * r + c] += u[r] * u[c];
+    }
+    pd_mat[3] = pd_mat[1], pd_mat[6] = pd_mat[2], pd_mat[7] = pd_mat[5];
+
+    double eigenvalues[3], eigenvectors[9];
+    symmetric_eigen3(pd_mat, eigenvalues, eigenvectors); //计算特征值特征向量
+
+    C a = (C) eigenvectors[6], b = (C) eigenvectors[7], c = (C) eigenvectors[8];
+    if (std::isinf(a) || std::isinf(b) || std::isinf(c) || (a == 0 && b == 0 && c == 0)) {
+        std::cerr << "tls estimate plane fail." << std::endl;
+        return false;
+    }
+
+    model = Vec<C, 4>(a, b, c, -a * mean_x - b * mean_y - c * mean_z);
+    return true;
+}
+
+/**
+ * Obtain a plane
+ *
+ * @param best_model  The best plane model (output)
+ * @param inliers  Mark whether it is the inner point of the plane model (output)
+ *
+ * @param pts  Point cloud
+ * @param thr  Threshold
+ * @param max_iterations  Maximum number of iterations
+ * @param constraint  Test a hypothesis must pass, NoNormalConstraint or NormalConstraint
+ * @param sampler  Draws the minimal samples and shuffles local optimisation samples
+ * @param stats  Run statistics to add to, nullptr to skip
+ * @param weights  Weight of every point, the inliers of a hypothesis are scored and the iteration bound derived by
+ *                 their summed weight
+ * @return number of points, their summed weight with PointWeights
+ */
+// 使用ransac算法进行最佳平面求解
+/*
+* 1. 随机选三个点，拟合平面
+* 2. 基于阈值计算平面内点数，当大于最佳平面内点数时，记为最佳平面
+*    若有预期法向，则当计算法向与预期法相相差较大时，重新计算跳过后面步骤
+* 3. 使用local ransac算法, 随机若干(20)采样内点，计算新平面, 若新内点个数超过最佳内点个数模型，则记为最佳平面
+* 4. 根据最佳内点个数，总点数，概率0.95以及最少拟合平面点数(3),计算最大迭代次数
+*/
+template<typename Prune, typename Constraint, typename Sampler, typename T, typename Weights = Unweighted>
+int get_plane(Vec<typename ScalarTraits<T>::compute_type, 4> &best_model, bool *inliers, const PointSpan<T> &pts,
+              float thr, int max_iterations, const Constraint &constraint, Sampler &sampler,
+              RansacStats *stats = nullptr, const Weights &weights = Weights()) {
+    typedef Vec<typename ScalarTraits<T>::compute_type, 4> Model;
+    PD_PROFILE_SCOPE("get_plane");
+    const int pts_size = pts.size, min_sample_size = 3, max_lo_inliers = 20, max_lo_iters = 10;
+    if (pts_size < 3) return 0;
+    const int total_weight = weights.remaining(0, pts_size);
+
+    Model model, lo_model;
+    std::vector<int> random_pool(pts_size);
+    mem_tracker::ScopedBytes random_pool_bytes(random_pool.capacity() * sizeof(int));
+    for (int p = 0; p < pts_size; ++p) random_pool[p] = p;
+
+    int *min_sample = mem_tracker::new_array<int>(min_sample_size);
+    int *inlier_sample = mem_tracker::new_array<int>(max_lo_inliers);
+    int best_inls = 0, num_inliers = 0;
+
+    for (int iter = 0; iter < max_iterations; ++iter) {
+        // Randomly select some points from the point cloud to fit the plane
+        sampler.sample(min_sample, min_sample_size, pts_size);
+
+        if (stats != nullptr) ++stats->hypotheses;
+
+        if (!total_least_squares_plane_estimate(model, pts, min_sample, min_sample_size)) {
+            if (stats != nullptr) ++stats->degenerate;
+            continue;
+        }
+
+        if (!constraint.accept(model)) {
+            if (stats != nullptr) ++stats->normal_rejected;
+            continue;
+        }
+
+        num_inliers = get_inliers<Prune>(inliers, model, pts, thr, best_inls, stats, weights);
+
+        if (num_inliers > best_inls) {
+
+            // The best model preserved so far
+            best_model = model;
+            best_inls = num_inliers;
+
+            // Local Optimization
+            for (int lo_iter = 0; lo_iter < max_lo_iters; ++lo_iter) {
+                shuffle(random_pool, sampler.rng());
+
+                // Randomly select some points from the interior points to fit the plane
+                int sample_cnt = 0;
+                for (int p : random_pool) {
+                    if (inliers[p]) {
+                        inlier_sample[sample_cnt] = p;
+                        ++sample_cnt;
+                        if (sample_cnt >= max_lo_inliers) break;
+                    }
+                }
+
+                if (!total_least_squares_plane_estimate(lo_model, pts, inlier_sample, sample_cnt))
+                    continue;
+
+                if (!constraint.accept(lo_model)) continue;
+
+                num_inliers = get_inliers<Prune>(inliers, lo_model, pts, thr, best_inls, stats, weights);
+
+                if (best_inls < num_inliers) {
+                    if (stats != nullptr) ++stats->lo_improvements;
+                    best_model = lo_model;
+                    best_inls = num_inliers;
+                } else if (best_inls == num_inliers) {
+                    break;
+                }
+            }
+
+            const double max_hyp = 3 * std::log(1 - 0.95) /
+                                   std::log(1 - std::pow(float(best_inls) / total_weight, min_sample_size));
+            if (!std::isinf(max_hyp) && max_hyp < max_iterations) {
+                max_iterations = static_cast<int>(max_hyp);
+            }
+        }
+    }
+
+    mem_tracker::delete_array(min_sample, min_sample_size);
+    mem_tracker::delete_array(inlier_sample, max_lo_inliers);
+    if (stats != nullptr) stats->iteration_bounds.push_back(max_iterations);
+    // Update the inliers of best_model
+    if (best_inls != 0 && best_inls >= num_inliers)
+        best_inls = get_inliers<NoPruning>(inliers, best_model, pts, thr, 0, stats, weights);
+    return best_inls;
+}
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_RANSAC_KERNELS_H
@@ -0,0 +1,54 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_RANSAC_OPENCV_H
+#define POINT_CLOUD_PLANE_DETECTION_RANSAC_OPENCV_H
+
+#include <opencv2/core.hpp>
+#include "ransac.h"
+
+/*
+ * OpenCV interface of the detector, a thin adapter over the OpenCV-free core of ransac.h.
+ */
+
+inline pd::Vec3f to_pd(const cv::Vec3f &v) {
+    return pd::Vec3f(v[0], v[1], v[2]);
+}
+
+inline pd::Vec4f to_pd(const cv::Vec4f &v) {
+    return pd::Vec4f(v[0], v[1], v[2], v[3]);
+}
+
+inline cv::Vec4f to_cv(const pd::Vec4f &v) {
+    return cv::Vec4f(v[0], v[1], v[2], v[3]);
+}
+
+/**
+ * View a point cloud as packed float points
+ *
+ * @param points3d  n × 3 or 3 × n matrix, or n points of 3 channels, or a vector of cv::Vec3f, of any depth
+ * @param buffer  Holds the points (output); the view is valid while buffer is, and shares points3d's memory
+ *                when it already is packed float
+ */
+pd::PointCloud to_point_cloud(cv::InputArray &points3d, cv::Mat &buffer);
+
+/**
+ * Get multiple planes
+ *
+ * @param labels  The label that the point belongs to a certain plane, n × 1 matrix, n is equal to the size of the input point cloud (output)
+ * @param planes  Holds the vector of plane equations, the equation is expressed as ax + by + cz + d = 0 (output)
+ * @param points3d  Input point cloud data
+ * @param thr  Threshold
+ * @param max_iterations  Maximum number of iterations
+ * @param desired_num_planes  Number of target planes
+ * @param grid_size  Downsampling grid size, if less than or equal to 0, it means no downsampling
+ * @param normal  Normal vector constraint, nullptr means no constraint is used, otherwise the detected plane normal vector satisfies the constraint
+ * @param normal_diff_thr  Tolerance of the normal vector constraint
+ * @param stats  Run statistics (output), reset at the start of the call, nullptr to skip
+ * @param weighted  Score every downsampled point by the number of points of its voxel while searching planes
+ * @param search  PD_SEARCH_RANSAC, PD_SEARCH_PROJECTION to find planes along normal without sampling, or
+ *                PD_SEARCH_MANHATTAN to find them along three orthogonal dominant directions
+ */
+void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray &points3d,
+                float thr, int max_iterations, int desired_num_planes = 1, float grid_size = -1,
+                cv::Vec3f *normal = nullptr, double normal_diff_thr = 0.06, RansacStats *stats = nullptr,
+                bool weighted = false, pd_search search = PD_SEARCH_RANSAC);
+
+#endif //POINT_CLOUD_PLANE_DETECTION_RANSAC_OPENCV_H
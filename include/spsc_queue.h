@@ -0,0 +1,107 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_SPSC_QUEUE_H
+#define POINT_CLOUD_PLANE_DETECTION_SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace pd {
+
+/**
+ * Bounded lock free queue between exactly one producer thread and one consumer thread.
+ *
+ * Positions only ever grow, slot i % capacity holds element i. Each side publishes its own position with a
+ * release store and reads the other side's with an acquire load, and keeps a private copy of it, so the shared
+ * cache lines are only touched when the cached position says the queue looks full or empty.
+ */
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots_(capacity > 0 ? capacity : 1), head_(0), tail_(0),
+                                          cached_head_(0), cached_tail_(0) {}
+
+    SpscQueue(const SpscQueue &) = delete;
+
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    /**
+     * Producer only, false if the queue is full
+     */
+    bool try_push(const T &value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) return false;
+        }
+        slots_[tail % slots_.size()] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer only, false if the queue is empty
+     */
+    bool try_pop(T &value) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) return false;
+        }
+        value = slots_[head % slots_.size()];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Number of elements, exact from the producer or the consumer, a snapshot from other threads
+     */
+    size_t size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T> slots_;
+    // The positions sit on separate cache lines, so the producer and the consumer do not invalidate each other
+    char pad0_[64];
+    std::atomic<size_t> head_;  // Next element to pop, written by the consumer
+    char pad1_[64];
+    std::atomic<size_t> tail_;  // Next element to push, written by the producer
+    char pad2_[64];
+    size_t cached_head_;        // Producer's copy of head_
+    char pad3_[64];
+    size_t cached_tail_;        // Consumer's copy of tail_
+};
+
+/**
+ * Waiting for a queue without a lock: spin briefly, then yield, then sleep, so a stage reacts within
+ * microseconds while busy and does not burn a CPU while idle
+ */
+class Backoff {
+public:
+    Backoff() : rounds_(0) {}
+
+    void wait() {
+        if (rounds_ < 64) {
+            ++rounds_;
+        } else if (rounds_ < 256) {
+            ++rounds_;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    void reset() { rounds_ = 0; }
+
+private:
+    int rounds_;
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_SPSC_QUEUE_H
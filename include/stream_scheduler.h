@@ -0,0 +1,105 @@
+#ifndef POINT_CLOUD_PLANE_DETECTION_STREAM_SCHEDULER_H
+#define POINT_CLOUD_PLANE_DETECTION_STREAM_SCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "detector.h"
+
+/*
+ * Concurrent detection of several streams of frames in one process. Every stream has its own Detector and sees
+ * its frames detected in order, one at a time; frames of different streams are detected concurrently and share
+ * the thread pool of parallel.h.
+ *
+ * Every frame is due latency_budget_s after it was submitted. The scheduler starts the waiting frame with the
+ * earliest deadline first, and the frames being detected get the pool workers earliest deadline first too (see
+ * pd::ScopedDeadline), so a stream close to its deadline is not held up by streams with time to spare.
+ */
+namespace pd {
+
+struct StreamOptions {
+    pd_params params;
+    double latency_budget_s = 0.1;  // A frame is due this long after it was submitted
+    int max_queued_frames = 0;      // Frames waiting beyond this are dropped oldest first, 0 for no limit
+
+    StreamOptions() { pd_default_params(&params); }
+};
+
+/**
+ * Outcome of one frame, passed to the callback of submit. labels and planes belong to the detector of the stream
+ * and are only valid during the callback.
+ */
+struct FrameResult {
+    int stream = 0;
+    uint64_t frame = 0;                         // Number of the frame in its stream, from 0
+    pd_status status = PD_OK;
+    bool dropped = false;                       // Skipped because the queue of the stream was full
+    bool deadline_met = false;
+    double queue_s = 0, latency_s = 0;          // From submission to the start of detection, and to its end
+    const std::vector<int> *labels = nullptr;
+    const std::vector<Vec4f> *planes = nullptr;
+};
+
+struct StreamStats {
+    long long frames = 0;            // Frames detected
+    long long dropped = 0;
+    long long deadline_misses = 0;
+    double total_latency_s = 0, max_latency_s = 0;
+};
+
+class StreamScheduler {
+public:
+    /**
+     * @param concurrency  Frames detected at the same time, 0 for get_num_threads()
+     */
+    explicit StreamScheduler(int concurrency = 0);
+
+    /**
+     * Finish the submitted frames and stop
+     */
+    ~StreamScheduler();
+
+    /**
+     * Add a stream with its own detector
+     *
+     * @return Id of the stream for submit and stats
+     */
+    int add_stream(const StreamOptions &options);
+
+    /**
+     * Queue a frame of a stream. The points must stay valid until done is called, an owned PointCloud keeps them
+     * alive. done runs on a scheduler thread and must not call back into the scheduler.
+     *
+     * @return Number of the frame in its stream
+     */
+    uint64_t submit(int stream, const PointCloud &frame, std::function<void(const FrameResult &)> done);
+
+    /**
+     * Wait until every submitted frame is done
+     */
+    void wait_idle();
+
+    StreamStats stats(int stream);
+
+private:
+    struct Frame;
+    struct Stream;
+
+    void runner_loop();
+
+    std::mutex mutex_;
+    std::condition_variable work_, idle_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    std::vector<std::thread> runners_;
+    int pending_;
+    bool stopping_;
+};
+
+}  // namespace pd
+
+#endif //POINT_CLOUD_PLANE_DETECTION_STREAM_SCHEDULER_H
@@ -2,17 +2,44 @@
 #ifndef POINT_CLOUD_PLANE_DETECTION_UTILS_H
 #define POINT_CLOUD_PLANE_DETECTION_UTILS_H
 
+#include <cstdint>
 #include <fstream>
 #include <opencv2/opencv.hpp>
 
+// Bounded rectangular plane patch of a synthetic scene
+struct PlanePatch {
+    cv::Vec3f center;
+    cv::Vec3f normal;                     // Any orientation, need not be unit length
+    float half_width, half_height;        // Half extents along two orthogonal in-plane axes
+};
+
+// Synthetic scene for generate_scene and generate_scene_ply
+struct SceneConfig {
+    std::vector<PlanePatch> patches;
+    long long num_points = 0;             // Total number of points, outliers included
+    float outlier_ratio = 0.1f;           // Fraction of points drawn uniformly from [-size, size]^3
+    float noise_sigma = 0.f;              // Standard deviation of the offset along the patch normal
+    float size = 100.f;
+    uint64_t seed = 1;
+};
+
 bool save_points_label(const std::string &file_path, cv::InputArray &labels, bool sync_io = false);
 
-bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, bool sync_io = false);
+bool read_points_label(cv::Mat &labels, const std::string &file_path, bool sync_io = false);
+
+bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, bool sync_io = false, bool binary = false);
 
 std::string get_plane_expression_str(cv::Vec4f model);
 
 bool read_point_cloud_ply_to_mat(cv::Mat &output, const std::string &file_path, bool sync_io = false);
 
-void point_cloud_generator(float size, int point_num, int noise_num, std::vector<cv::Vec4f> models, cv::Mat &point_cloud);
+void point_cloud_generator(float size, int point_num, int noise_num, std::vector<cv::Vec4f> models, cv::Mat &point_cloud,
+                           uint64_t seed = 0x5eed);
+
+std::vector<PlanePatch> random_plane_patches(int num_patches, float size, uint64_t seed);
+
+void generate_scene(cv::Mat &point_cloud, cv::Mat *labels, const SceneConfig &config);
+
+bool generate_scene_ply(const std::string &file_path, const SceneConfig &config, const std::string &label_path = "");
 
 #endif //POINT_CLOUD_PLANE_DETECTION_UTILS_H
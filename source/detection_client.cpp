@@ -0,0 +1,212 @@
+#include "detection_client.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "detection_protocol.h"
+
+namespace pd {
+
+namespace {
+
+/*
+ * Anonymous shared memory of size bytes, a memfd on Linux and an unlinked POSIX shared memory object elsewhere.
+ * The memfd is sealed at its size, the server refuses rings it could lose pages of.
+ */
+int create_shared_memory(size_t size) {
+#ifdef __linux__
+    int fd = memfd_create("plane_detection_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    static std::atomic<int> counter(0);
+    const std::string name = "/plane_detection_ring-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd >= 0) shm_unlink(name.c_str());
+#endif
+    if (fd >= 0 && ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        return -1;
+    }
+#ifdef __linux__
+    if (fd >= 0 && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+        close(fd);
+        return -1;
+    }
+#endif
+    return fd;
+}
+
+size_t round_up(size_t bytes) {
+    return (bytes + 63) / 64 * 64;
+}
+
+}  // namespace
+
+DetectionClient::DetectionClient() : fd_(-1), ring_(nullptr), ring_bytes_(0), head_(0), next_id_(1) {}
+
+DetectionClient::~DetectionClient() {
+    disconnect();
+}
+
+bool DetectionClient::connect(const std::string &socket_path, size_t ring_bytes) {
+    disconnect();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid socket path: " << socket_path << "\n";
+        return false;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || ::connect(fd_, (const sockaddr *) &address, sizeof(address)) != 0) {
+        std::cerr << "Cannot connect to " << socket_path << ": " << strerror(errno) << "\n";
+        disconnect();
+        return false;
+    }
+
+    int ring_fd = create_shared_memory(ring_bytes);
+    void *ring = ring_fd < 0 ? MAP_FAILED : mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+    if (ring == MAP_FAILED) {
+        std::cerr << "Cannot create a shared ring of " << ring_bytes << " bytes: " << strerror(errno) << "\n";
+        if (ring_fd >= 0) close(ring_fd);
+        disconnect();
+        return false;
+    }
+    ring_ = (char *) ring;
+    ring_bytes_ = ring_bytes;
+
+    protocol::Hello hello = {protocol::magic, protocol::hello, (uint64_t) ring_bytes};
+    protocol::HelloReply reply = {};
+    const bool sent = protocol::send_with_fd(fd_, &hello, sizeof(hello), ring_fd);
+    close(ring_fd);
+    if (!sent || !protocol::recv_all(fd_, &reply, sizeof(reply)) || reply.status != PD_OK) {
+        std::cerr << "Detection server refused the connection: " << pd_status_string((pd_status) reply.status) << "\n";
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void DetectionClient::disconnect() {
+    if (fd_ >= 0) close(fd_);
+    if (ring_ != nullptr) munmap(ring_, ring_bytes_);
+    fd_ = -1;
+    ring_ = nullptr;
+    ring_bytes_ = head_ = 0;
+    in_flight_.clear();
+    finished_.clear();
+}
+
+/*
+ * Find bytes of contiguous ring space after the newest slot, wrapping to the start when the end is too short.
+ * The space in use runs from the oldest slot in flight to head_.
+ */
+bool DetectionClient::allocate(size_t bytes, size_t &offset) {
+    if (in_flight_.empty()) head_ = 0;
+    const size_t tail = in_flight_.empty() ? 0 : in_flight_.front().offset;
+    if (in_flight_.empty() || head_ > tail) {
+        if (bytes <= ring_bytes_ - head_) {
+            offset = head_;
+        } else if (bytes < tail) {
+            offset = 0;
+        } else {
+            return false;
+        }
+    } else if (bytes < tail - head_) {
+        offset = head_;
+    } else {
+        return false;
+    }
+    head_ = offset + bytes;
+    return true;
+}
+
+uint64_t DetectionClient::submit(const float *xyz, int n, const pd_params &params) {
+    if (fd_ < 0 || n < 0) return 0;
+    const size_t points_bytes = round_up(3 * sizeof(float) * (size_t) n);
+    const size_t bytes = points_bytes + round_up(sizeof(int32_t) * (size_t) n);
+    size_t offset;
+    while (!allocate(bytes, offset)) {
+        if (in_flight_.empty()) {
+            std::cerr << "A frame of " << n << " points does not fit in a ring of " << ring_bytes_ << " bytes\n";
+            return 0;
+        }
+        // Wait for the oldest frame to free its space
+        if (!read_reply()) return 0;
+    }
+
+    memcpy(ring_ + offset, xyz, 3 * sizeof(float) * (size_t) n);
+    protocol::DetectRequest request = {protocol::magic, protocol::detect, next_id_++, offset, offset + points_bytes,
+                                       (uint64_t) n, params};
+    in_flight_.push_back(Slot{request.id, offset, bytes, n, false});
+    if (!protocol::send_all(fd_, &request, sizeof(request))) {
+        std::cerr << "Lost the connection to the detection server\n";
+        disconnect();
+        return 0;
+    }
+    return request.id;
+}
+
+bool DetectionClient::read_reply() {
+    protocol::DetectReply reply;
+    DetectionResult result;
+    if (!protocol::recv_all(fd_, &reply, sizeof(reply)) || reply.num_planes > protocol::max_planes) {
+        std::cerr << "Lost the connection to the detection server\n";
+        disconnect();
+        return false;
+    }
+    result.planes.resize(reply.num_planes);
+    if (reply.num_planes > 0 && !protocol::recv_all(fd_, result.planes.data(), reply.num_planes * sizeof(Vec4f))) {
+        disconnect();
+        return false;
+    }
+    result.id = reply.id;
+    result.status = (pd_status) reply.status;
+    result.queue_s = reply.queue_s;
+    result.detect_s = reply.detect_s;
+
+    for (Slot &slot : in_flight_) {
+        if (slot.id != reply.id) continue;
+        if (result.status == PD_OK) {
+            const int32_t *labels = (const int32_t *) (ring_ + slot.offset + round_up(3 * sizeof(float) * slot.num_points));
+            result.labels.assign(labels, labels + slot.num_points);
+        }
+        slot.done = true;
+    }
+    while (!in_flight_.empty() && in_flight_.front().done) in_flight_.pop_front();
+    finished_.push_back(std::move(result));
+    return true;
+}
+
+bool DetectionClient::receive(DetectionResult &result) {
+    while (finished_.empty()) {
+        if (in_flight_.empty() || !read_reply()) return false;
+    }
+    result = std::move(finished_.front());
+    finished_.pop_front();
+    return true;
+}
+
+bool DetectionClient::detect(DetectionResult &result, const float *xyz, int n, const pd_params &params) {
+    const uint64_t id = submit(xyz, n, params);
+    if (id == 0) return false;
+    // Results of earlier requests stay in finished_ for receive
+    for (;;) {
+        for (auto it = finished_.begin(); it != finished_.end(); ++it) {
+            if (it->id != id) continue;
+            result = std::move(*it);
+            finished_.erase(it);
+            return true;
+        }
+        if (in_flight_.empty() || !read_reply()) return false;
+    }
+}
+
+}  // namespace pd
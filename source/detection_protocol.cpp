@@ -0,0 +1,94 @@
+#include "detection_protocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#ifdef MSG_NOSIGNAL
+#define PD_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define PD_SEND_FLAGS 0
+#endif
+
+namespace pd {
+namespace protocol {
+
+bool send_all(int fd, const void *data, size_t size) {
+    const char *p = (const char *) data;
+    while (size > 0) {
+        ssize_t sent = send(fd, p, size, PD_SEND_FLAGS);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        size -= (size_t) sent;
+    }
+    return true;
+}
+
+bool recv_all(int fd, void *data, size_t size) {
+    char *p = (char *) data;
+    while (size > 0) {
+        ssize_t received = recv(fd, p, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        p += received;
+        size -= (size_t) received;
+    }
+    return true;
+}
+
+bool send_with_fd(int fd, const void *data, size_t size, int attached_fd) {
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    iovec iov = {const_cast<void *>(data), size};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &attached_fd, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, PD_SEND_FLAGS);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) return false;
+    // The descriptor went with the first byte, the rest is plain data
+    return send_all(fd, (const char *) data + sent, size - (size_t) sent);
+}
+
+bool recv_with_fd(int fd, void *data, size_t size, int &attached_fd) {
+    attached_fd = -1;
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    iovec iov = {data, size};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received;
+    do {
+        received = recvmsg(fd, &msg, 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) return false;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&attached_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return recv_all(fd, (char *) data + received, size - (size_t) received);
+}
+
+}  // namespace protocol
+}  // namespace pd
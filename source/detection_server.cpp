@@ -0,0 +1,244 @@
+#include "detection_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "detection_protocol.h"
+#include "profiler.h"
+#include "ransac.h"
+
+#ifndef INFO
+#define INFO 1
+#endif
+
+namespace pd {
+
+/*
+ * Whether the ring a client sent can be mapped safely: it holds at least ring_bytes, and on Linux it is a memfd
+ * sealed against shrinking and growing, so the client cannot truncate it under the mapping and make the detectors
+ * fault on the lost pages
+ */
+static bool usable_ring(int ring_fd, uint64_t ring_bytes) {
+    struct stat st;
+    if (ring_bytes == 0 || fstat(ring_fd, &st) != 0 || st.st_size < 0 || (uint64_t) st.st_size < ring_bytes)
+        return false;
+#ifdef __linux__
+    const int seals = fcntl(ring_fd, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) return false;
+#endif
+    return true;
+}
+
+/*
+ * A client: its socket, replies are written by the detectors under write_mutex, and its ring mapped read write
+ */
+struct DetectionServer::Connection {
+    int fd = -1;
+    char *ring = nullptr;
+    size_t ring_bytes = 0;
+    std::mutex write_mutex;
+
+    ~Connection() {
+        if (ring != nullptr) munmap(ring, ring_bytes);
+        if (fd >= 0) close(fd);
+    }
+
+    void reply(const protocol::DetectReply &reply, const float *planes) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        // A client that went away gets no reply, its connection thread notices the closed socket
+        if (protocol::send_all(fd, &reply, sizeof(reply)) && reply.num_planes > 0)
+            protocol::send_all(fd, planes, reply.num_planes * 4 * sizeof(float));
+    }
+};
+
+struct DetectionServer::Job {
+    std::shared_ptr<Connection> connection;
+    protocol::DetectRequest request;
+    double queued_at;
+};
+
+DetectionServer::DetectionServer() : listen_fd_(-1), stopping_(false) {}
+
+DetectionServer::~DetectionServer() {
+    stop();
+}
+
+bool DetectionServer::start(const ServerOptions &options) {
+    options_ = options;
+    options_.queue_capacity = std::max(1, options_.queue_capacity);
+    options_.detectors = std::max(1, options_.detectors);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options_.socket_path.empty() || options_.socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid socket path: " << options_.socket_path << "\n";
+        return false;
+    }
+    strcpy(address.sun_path, options_.socket_path.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        std::cerr << "socket error: " << strerror(errno) << "\n";
+        return false;
+    }
+    unlink(options_.socket_path.c_str());
+    if (bind(listen_fd_, (const sockaddr *) &address, sizeof(address)) != 0 || listen(listen_fd_, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << options_.socket_path << ": " << strerror(errno) << "\n";
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    stopping_ = false;
+    for (int i = 0; i < options_.detectors; ++i) detector_threads_.emplace_back(&DetectionServer::detector_loop, this);
+    accept_thread_ = std::thread(&DetectionServer::accept_loop, this);
+#if INFO
+    printf("Detection server listening on %s, queue capacity %d, detectors %d\n", options_.socket_path.c_str(),
+           options_.queue_capacity, options_.detectors);
+#endif
+    return true;
+}
+
+void DetectionServer::stop() {
+    if (listen_fd_ < 0) return;
+    stopping_ = true;
+
+    // Unblock accept, then every connection thread blocked in recv or on the full queue
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    close(listen_fd_);
+    listen_fd_ = -1;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (const std::shared_ptr<Connection> &connection : connections_) shutdown(connection->fd, SHUT_RDWR);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_.clear();
+    }
+    queue_not_empty_.notify_all();
+    queue_not_full_.notify_all();
+
+    for (std::thread &thread : detector_threads_) thread.join();
+    detector_threads_.clear();
+    {
+        std::unique_lock<std::mutex> lock(connections_mutex_);
+        connections_closed_.wait(lock, [this]() { return connections_.empty(); });
+    }
+    unlink(options_.socket_path.c_str());
+}
+
+int DetectionServer::queue_depth() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return (int) queue_.size();
+}
+
+void DetectionServer::accept_loop() {
+    for (;;) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (stopping_) return;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept error: " << strerror(errno) << "\n";
+            return;
+        }
+        std::shared_ptr<Connection> connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            if (stopping_) return;
+            connections_.push_back(connection);
+        }
+        std::thread(&DetectionServer::connection_loop, this, connection).detach();
+    }
+}
+
+void DetectionServer::connection_loop(std::shared_ptr<Connection> connection) {
+    protocol::Hello hello = {};
+    int ring_fd = -1;
+    protocol::HelloReply hello_reply = {PD_OK, options_.queue_capacity};
+    if (!protocol::recv_with_fd(connection->fd, &hello, sizeof(hello), ring_fd) || hello.magic != protocol::magic ||
+        hello.type != protocol::hello || ring_fd < 0 || !usable_ring(ring_fd, hello.ring_bytes)) {
+        hello_reply.status = PD_ERROR_INVALID_ARGUMENT;
+    } else {
+        void *ring = mmap(nullptr, (size_t) hello.ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+        if (ring == MAP_FAILED) {
+            hello_reply.status = PD_ERROR_OUT_OF_MEMORY;
+        } else {
+            connection->ring = (char *) ring;
+            connection->ring_bytes = (size_t) hello.ring_bytes;
+        }
+    }
+    if (ring_fd >= 0) close(ring_fd);
+
+    if (protocol::send_all(connection->fd, &hello_reply, sizeof(hello_reply)) && hello_reply.status == PD_OK) {
+        protocol::DetectRequest request;
+        while (protocol::recv_all(connection->fd, &request, sizeof(request))) {
+            // Requests must name points and labels inside the ring
+            const uint64_t n = request.num_points, ring_bytes = connection->ring_bytes;
+            if (request.magic != protocol::magic || request.type != protocol::detect || n > INT_MAX ||
+                request.points_offset % sizeof(float) != 0 || request.labels_offset % sizeof(int32_t) != 0 ||
+                request.points_offset > ring_bytes || 3 * sizeof(float) * n > ring_bytes - request.points_offset ||
+                request.labels_offset > ring_bytes || sizeof(int32_t) * n > ring_bytes - request.labels_offset) {
+                protocol::DetectReply reply = {request.id, PD_ERROR_INVALID_ARGUMENT, 0, 0, 0};
+                connection->reply(reply, nullptr);
+                continue;
+            }
+
+            std::unique_ptr<Job> job(new Job{connection, request, profiler::now_s()});
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            // Back-pressure: stop reading from this client until a detector frees a slot
+            queue_not_full_.wait(lock, [this]() {
+                return stopping_ || (int) queue_.size() < options_.queue_capacity;
+            });
+            if (stopping_) break;
+            queue_.push_back(std::move(job));
+            lock.unlock();
+            queue_not_empty_.notify_one();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    connections_.erase(std::find(connections_.begin(), connections_.end(), connection));
+    connections_closed_.notify_all();
+}
+
+void DetectionServer::detector_loop() {
+    // A table per request from every detector would flood the output of the daemon and add to its latency
+    const QuietProgress quiet;
+    std::vector<float> planes(4 * protocol::max_planes);
+    for (;;) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_not_empty_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        queue_not_full_.notify_one();
+
+        PD_PROFILE_SCOPE("serve_request");
+        const protocol::DetectRequest &request = job->request;
+        const double start = profiler::now_s();
+        size_t num_planes = 0;
+        pd_status status = pd_get_planes((const float *) (job->connection->ring + request.points_offset),
+                                         (size_t) request.num_points, 0, &request.params,
+                                         (int32_t *) (job->connection->ring + request.labels_offset),
+                                         planes.data(), protocol::max_planes, &num_planes);
+        protocol::DetectReply reply = {request.id, status, status == PD_OK ? (uint32_t) num_planes : 0,
+                                       start - job->queued_at, profiler::now_s() - start};
+        job->connection->reply(reply, planes.data());
+    }
+}
+
+}  // namespace pd
@@ -0,0 +1,56 @@
+#include "detector.h"
+
+#include <new>
+#include <stdexcept>
+
+namespace pd {
+
+pd_status validate_params(const pd_params &params, std::string &error) {
+    if (params.desired_num_planes < 1 || params.max_iterations < 1) {
+        error = "desired_num_planes and max_iterations must be positive";
+        return PD_ERROR_INVALID_ARGUMENT;
+    }
+    if (params.search != PD_SEARCH_RANSAC && params.search != PD_SEARCH_PROJECTION &&
+        params.search != PD_SEARCH_MANHATTAN) {
+        error = "unknown search";
+        return PD_ERROR_INVALID_ARGUMENT;
+    }
+    if (params.search == PD_SEARCH_PROJECTION && !params.use_normal) {
+        error = "PD_SEARCH_PROJECTION needs use_normal";
+        return PD_ERROR_INVALID_ARGUMENT;
+    }
+    return PD_OK;
+}
+
+Detector::Detector(const pd_params &params) : params_(params) {}
+
+pd_status Detector::detect(const PointCloud &frame) {
+    error_.clear();
+    planes_.clear();
+    if (frame.size() < 3) {
+        error_ = "a frame needs at least 3 points";
+        return PD_ERROR_INVALID_ARGUMENT;
+    }
+    const pd_status status = validate_params(params_, error_);
+    if (status != PD_OK) return status;
+
+    try {
+        // Streams detect frame after frame, often several at the same time, the progress tables would interleave
+        const QuietProgress quiet;
+        // resize keeps the capacity, so a stream of similar frames allocates its labels once
+        labels_.resize(frame.size());
+        const Vec3f normal(params_.normal[0], params_.normal[1], params_.normal[2]);
+        get_planes(labels_.data(), planes_, frame, params_.threshold, params_.max_iterations,
+                   params_.desired_num_planes, params_.grid_size, params_.use_normal ? &normal : nullptr,
+                   params_.normal_diff_thr, &stats_, params_.weighted != 0, (pd_search) params_.search);
+    } catch (const std::bad_alloc &) {
+        error_ = "out of memory";
+        return PD_ERROR_OUT_OF_MEMORY;
+    } catch (const std::exception &e) {
+        error_ = e.what();
+        return PD_ERROR_INTERNAL;
+    }
+    return PD_OK;
+}
+
+}  // namespace pd
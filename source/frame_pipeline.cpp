@@ -0,0 +1,180 @@
+#include "frame_pipeline.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "parallel.h"
+#include "profiler.h"
+#include "ransac_opencv.h"
+#include "utils.h"
+
+namespace pd {
+
+namespace {
+
+template<typename T>
+void push_waiting(SpscQueue<T> &queue, const T &value) {
+    Backoff backoff;
+    while (!queue.try_push(value)) backoff.wait();
+}
+
+/*
+ * Pop from a queue, returns the time spent waiting
+ */
+template<typename T>
+double pop_waiting(SpscQueue<T> &queue, T &value) {
+    if (queue.try_pop(value)) return 0;
+    const double start = profiler::now_s();
+    Backoff backoff;
+    while (!queue.try_pop(value)) backoff.wait();
+    return profiler::now_s() - start;
+}
+
+}  // namespace
+
+FramePipeline::FramePipeline(const PipelineOptions &options)
+        : options_(options), frames_(std::max(1, options.pool_frames)), free_(frames_.size()),
+          to_detect_(std::max(1, options.queue_capacity)), to_write_(std::max(1, options.queue_capacity)) {
+    for (PipelineFrame &frame : frames_) free_.try_push(&frame);
+}
+
+PipelineStats FramePipeline::run(const Source &source, const Sink &sink) {
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_ = PipelineStats();
+    }
+    // The read stage keeps the frame it took when the source ended, it goes back to the pool after the run
+    PipelineFrame *unused = nullptr;
+
+    std::thread reader([&]() {
+        for (uint64_t number = 0;; ++number) {
+            PipelineFrame *frame;
+            const double wait_s = pop_waiting(free_, frame);
+            const size_t free_frames = free_.size() + 1;
+            frame->number = number;
+            frame->ok = false;
+            frame->planes.clear();
+            frame->read_start = profiler::now_s();
+            bool more = true;
+            // An exception must not leave the thread, the frame goes on as a failed one
+            try {
+                more = source(*frame);
+            } catch (const std::exception &e) {
+                std::cerr << "Reading frame " << number << " failed: " << e.what() << "\n";
+                frame->ok = false;
+            } catch (...) {
+                std::cerr << "Reading frame " << number << " failed\n";
+                frame->ok = false;
+            }
+            frame->read_end = profiler::now_s();
+            if (!more) {
+                unused = frame;
+                push_waiting(to_detect_, (PipelineFrame *) nullptr);
+                return;
+            }
+            record(stats_.read, wait_s, frame->read_end - frame->read_start, free_frames);
+            push_waiting(to_detect_, frame);
+        }
+    });
+
+    std::thread writer([&]() {
+        for (;;) {
+            PipelineFrame *frame;
+            const double wait_s = pop_waiting(to_write_, frame);
+            if (frame == nullptr) return;
+            const size_t depth = to_write_.size() + 1;
+            frame->write_start = profiler::now_s();
+            sink(*frame);
+            frame->write_end = profiler::now_s();
+            record(stats_.write, wait_s, frame->write_end - frame->write_start, depth);
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                const double latency = frame->write_end - frame->read_start;
+                ++stats_.frames;
+                if (latency > options_.latency_budget_s) ++stats_.over_budget;
+                stats_.total_latency_s += latency;
+                stats_.max_latency_s = std::max(stats_.max_latency_s, latency);
+            }
+            push_waiting(free_, frame);
+        }
+    });
+
+    // A progress table per frame would count in the detect stage and its latency budget
+    const QuietProgress quiet;
+    for (;;) {
+        PipelineFrame *frame;
+        const double wait_s = pop_waiting(to_detect_, frame);
+        if (frame == nullptr) {
+            push_waiting(to_write_, frame);
+            break;
+        }
+        const size_t depth = to_detect_.size() + 1;
+        frame->detect_start = profiler::now_s();
+        if (frame->ok) {
+            PD_PROFILE_SCOPE("pipeline_detect");
+            // Pool work of a late frame goes first, see ScopedDeadline
+            ScopedDeadline deadline(frame->read_start + options_.latency_budget_s);
+            const pd_params &p = options_.params;
+            cv::Vec3f normal(p.normal[0], p.normal[1], p.normal[2]);
+            frame->stats = RansacStats();
+            try {
+                get_planes(frame->labels, frame->planes, frame->points, p.threshold, p.max_iterations,
+                           p.desired_num_planes, p.grid_size, p.use_normal ? &normal : nullptr, p.normal_diff_thr,
+                           &frame->stats, p.weighted != 0, (pd_search) p.search);
+            } catch (const std::exception &e) {
+                std::cerr << "Detection of frame " << frame->number << " failed: " << e.what() << "\n";
+                frame->ok = false;
+            }
+        }
+        frame->detect_end = profiler::now_s();
+        record(stats_.detect, wait_s, frame->detect_end - frame->detect_start, depth);
+        push_waiting(to_write_, frame);
+    }
+
+    reader.join();
+    writer.join();
+    // Every stage has stopped, this thread may now act as the producer of the pool
+    free_.try_push(unused);
+    return stats();
+}
+
+PipelineStats FramePipeline::stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void FramePipeline::queue_depths(int &to_detect, int &to_write) {
+    to_detect = (int) to_detect_.size();
+    to_write = (int) to_write_.size();
+}
+
+void FramePipeline::record(StageStats &stage, double wait_s, double busy_s, size_t queue_depth) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stage.frames;
+    stage.total_s += busy_s;
+    stage.max_s = std::max(stage.max_s, busy_s);
+    stage.total_wait_s += wait_s;
+    stage.total_queue_depth += (long long) queue_depth;
+    stage.max_queue_depth = std::max(stage.max_queue_depth, (int) queue_depth);
+}
+
+// The stages read and write files concurrently, so they keep the standard streams synchronized rather than
+// switching them from two threads at once; file streams are not affected by the setting
+FramePipeline::Source FramePipeline::ply_files(const std::vector<std::string> &paths) {
+    std::shared_ptr<size_t> next = std::make_shared<size_t>(0);
+    return [paths, next](PipelineFrame &frame) {
+        if (*next >= paths.size()) return false;
+        frame.path = paths[(*next)++];
+        frame.ok = read_point_cloud_ply_to_mat(frame.points, frame.path, true);
+        return true;
+    };
+}
+
+FramePipeline::Sink FramePipeline::label_files(const std::string &suffix) {
+    return [suffix](PipelineFrame &frame) {
+        if (frame.ok) save_points_label(frame.path + suffix, frame.labels, true);
+    };
+}
+
+}  // namespace pd
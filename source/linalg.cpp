@@ -0,0 +1,60 @@
+#include "linalg.h"
+
+#include <cmath>
+#include <utility>
+
+namespace pd {
+
+void symmetric_eigen3(const double m[9], double values[3], double vectors[9]) {
+    double a[3][3], v[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            a[i][j] = m[3 * i + j];
+            v[i][j] = i == j ? 1 : 0;
+        }
+    }
+
+    // A 3 × 3 matrix converges in a handful of sweeps, the bound only guards against NaN input
+    for (int sweep = 0; sweep < 50; ++sweep) {
+        double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+        if (!(off > 1e-30 * diag)) break;
+
+        for (int p = 0; p < 2; ++p) {
+            for (int q = p + 1; q < 3; ++q) {
+                if (a[p][q] == 0) continue;
+                // Rotation in the p, q plane that zeroes a[p][q]
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < 3; ++k) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    // The columns of v are the eigenvectors, sort them by descending eigenvalue
+    int order[3] = {0, 1, 2};
+    for (int i = 0; i < 3; ++i)
+        for (int j = i + 1; j < 3; ++j)
+            if (a[order[j]][order[j]] > a[order[i]][order[i]]) std::swap(order[i], order[j]);
+    for (int i = 0; i < 3; ++i) {
+        values[i] = a[order[i]][order[i]];
+        for (int k = 0; k < 3; ++k) vectors[3 * i + k] = v[k][order[i]];
+    }
+}
+
+}  // namespace pd
@@ -1,7 +1,14 @@
+#include <atomic>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include<opencv2/opencv.hpp>
-#include "ransac.h"
+#include "ransac_opencv.h"
 #include "utils.h"
+#include "json_writer.h"
+#include "parallel.h"
+#include "profiler.h"
 
 #ifndef INFO
 #define INFO 1
@@ -13,62 +20,366 @@ using namespace std;
 * command syntax
 */
 void usage() {
-    printf("Usage:  Point-Cloud-Plane-Detection desired_num_planes thr grid_size max_iters test_file_path normal\n"
+    printf("Usage:  Point-Cloud-Plane-Detection desired_num_planes thr grid_size max_iters test_file_path nx ny nz\n"
            "\tdesired_num_planes\t\t Number of detected planes \n"
            "\tthr\t\t Distance threshold from point to plane\n"
            "\tgrid_size\t\t The size of the grid used for downsampling\n"
            "\tmax_iters\t\t Maximum iterations of RANSAC for each plane detection \n"
            "\ttest_file_path\t\t Path of test point cloud file \n"
-           "\tnormal\t\t Normal vector constraint \n");
+           "\tnx ny nz\t\t Normal vector constraint, 0 0 0 for none \n"
+           "\n"
+           "        Point-Cloud-Plane-Detection [options] file.ply...\n"
+           "\tDetects every combination of the parameter lists in every file, in parallel, and writes a JSON manifest\n"
+           "\t--planes list\t\t Numbers of detected planes, comma separated (default 3)\n"
+           "\t--thr list\t\t Distance thresholds (default 0.2)\n"
+           "\t--grid list\t\t Downsampling grid sizes, 0 for none (default 0.2)\n"
+           "\t--iters list\t\t Maximum RANSAC iterations (default 1000)\n"
+           "\t--normal nx,ny,nz\t\t Normal vector constraint (default none)\n"
+           "\t--normal_thr d\t\t Tolerance of the normal vector constraint (default 0.06)\n"
+           "\t--weighted 0|1\t\t Score downsampled points by the points of their voxel (default 0)\n"
+           "\t--search ransac|projection|manhattan\t Plane search, projection needs --normal, manhattan takes it as its first\n"
+           "\t\t\t\t direction (default ransac)\n"
+           "\t--threads n\t\t Threads shared by all detections, 0 for every CPU (default 0)\n"
+           "\t--output_dir dir\t\t Directory of the label files (default next to every input)\n"
+           "\t--labels 0|1\t\t Write the label files (default 1)\n"
+           "\t--manifest path\t\t JSON results (default results.json)\n");
 }
 
-int main(int argc, char *argv[]) {
+/*
+ * Batch of files and parameter lists, the legacy positional form is a batch of one file and one combination
+ */
+struct BatchOptions {
+    vector<string> files;
+    vector<int> planes{3}, iters{1000};
+    vector<float> thrs{0.2f}, grids{0.2f};
+    cv::Vec3f normal{0, 0, 0};
+    double normal_thr = 0.06;
+    bool weighted = false;
+    pd_search search = PD_SEARCH_RANSAC;
+    int threads = 0;
+    string output_dir;
+    bool write_labels = true;
+    string manifest = "results.json";
+};
 
-    if (argc < 8) {
-        usage();
-        return 1;
+/*
+ * One input file, read by the first of its runs and released after the last
+ */
+struct InputFile {
+    string path;
+    once_flag read_once;
+    shared_ptr<cv::Mat> points;
+    bool ok = false;
+    string error;
+    double read_s = 0;
+    atomic<int> remaining{0};
+};
+
+/*
+ * One detection: a file with one combination of the parameters
+ */
+struct Run {
+    InputFile *file = nullptr;
+    int desired_num_planes = 0, max_iters = 0;
+    float thr = 0, grid_size = 0;
+    bool ok = false;
+    string error, label_path;
+    int num_points = 0;
+    double detect_s = 0, save_s = 0;
+    vector<cv::Vec4f> planes;
+    vector<int> inliers;
+    RansacStats stats;
+};
+
+template<typename T>
+bool parse_number(const char *s, T &value) {
+    stringstream is(s);
+    return (is >> value) && is.peek() == EOF;
+}
+
+template<typename T>
+bool parse_list(const string &s, vector<T> &out) {
+    out.clear();
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        T v;
+        if (!parse_number(item.c_str(), v)) return false;
+        out.push_back(v);
     }
+    return !out.empty();
+}
 
-    int desired_num_planes = stoi(argv[1]);
-    float thr = stof(argv[2]);
-    float grid_size = stof(argv[3]);
-    int max_iters = stoi(argv[4]);
-    string test_file_path = argv[5];
-    float nor1 = stof(argv[6]), nor2 = stof(argv[7]), nor3 = stof(argv[8]);
+bool parse_options(int argc, char *argv[], BatchOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            options.files.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        string val = argv[++i];
+        bool ok = true;
+        if (arg == "--planes") ok = parse_list(val, options.planes);
+        else if (arg == "--thr") ok = parse_list(val, options.thrs);
+        else if (arg == "--grid") ok = parse_list(val, options.grids);
+        else if (arg == "--iters") ok = parse_list(val, options.iters);
+        else if (arg == "--normal") {
+            vector<float> n;
+            ok = parse_list(val, n) && n.size() == 3;
+            if (ok) options.normal = cv::Vec3f(n[0], n[1], n[2]);
+        } else if (arg == "--normal_thr") ok = parse_number(val.c_str(), options.normal_thr);
+        else if (arg == "--weighted") ok = parse_number(val.c_str(), options.weighted);
+        else if (arg == "--search") {
+            ok = val == "ransac" || val == "projection" || val == "manhattan";
+            options.search = val == "projection" ? PD_SEARCH_PROJECTION :
+                             val == "manhattan" ? PD_SEARCH_MANHATTAN : PD_SEARCH_RANSAC;
+        } else if (arg == "--threads") ok = parse_number(val.c_str(), options.threads);
+        else if (arg == "--output_dir") options.output_dir = val;
+        else if (arg == "--labels") ok = parse_number(val.c_str(), options.write_labels);
+        else if (arg == "--manifest") options.manifest = val;
+        else ok = false;
+        if (!ok) return false;
+    }
+    if (options.search == PD_SEARCH_PROJECTION && options.normal == cv::Vec3f(0, 0, 0)) return false;
+    return !options.files.empty();
+}
+
+/*
+ * The legacy form: desired_num_planes thr grid_size max_iters test_file_path nx ny nz
+ */
+bool parse_positional(int argc, char *argv[], BatchOptions &options) {
+    int planes, iters;
+    float thr, grid_size, n[3];
+    if (argc != 9 || !parse_number(argv[1], planes) || !parse_number(argv[2], thr) ||
+        !parse_number(argv[3], grid_size) || !parse_number(argv[4], iters) || !parse_number(argv[6], n[0]) ||
+        !parse_number(argv[7], n[1]) || !parse_number(argv[8], n[2])) {
+        return false;
+    }
+    options.planes = {planes};
+    options.thrs = {thr};
+    options.grids = {grid_size};
+    options.iters = {iters};
+    options.files = {argv[5]};
+    options.normal = cv::Vec3f(n[0], n[1], n[2]);
+    options.manifest.clear();
+    return true;
+}
+
+string label_path(const BatchOptions &options, const Run &run) {
+    string base = run.file->path;
+    if (!options.output_dir.empty()) {
+        size_t slash = base.find_last_of("/\\");
+        base = options.output_dir + "/" + (slash == string::npos ? base : base.substr(slash + 1));
+    }
+    char suffix[256];
+    sprintf(suffix, "-thr_%4f-iter_%d-grid_size_%4f-planes-%d-label.txt",
+            run.thr, run.max_iters, run.grid_size, run.desired_num_planes);
+    return base + suffix;
+}
+
+/*
+ * Read the file of a run if no other run did yet, detect, save the labels, and release the points after the last
+ * run of the file. Runs of different files and parameters execute concurrently.
+ */
+void detect(const BatchOptions &options, Run &run) {
+    InputFile &file = *run.file;
+    call_once(file.read_once, [&file]() {
+        double start = profiler::now_s();
+        // A failed read is a failure of every run of the file, not of the batch
+        try {
+            file.points = make_shared<cv::Mat>();
+            // Other runs read and write files at the same time, see sync_io
+            file.ok = read_point_cloud_ply_to_mat(*file.points, file.path, true);
+        } catch (const exception &e) {
+            file.ok = false;
+            file.error = e.what();
+        } catch (...) {
+            file.ok = false;
+            file.error = "unknown error";
+        }
+        file.read_s = profiler::now_s() - start;
+    });
+    shared_ptr<cv::Mat> points = file.points;
+    if (--file.remaining == 0) file.points.reset();
 
+    if (!file.ok) {
+        run.error = "cannot read " + file.path + (file.error.empty() ? "" : ": " + file.error);
+        return;
+    }
+    run.num_points = points->rows;
 
-    cv::Mat point_cloud;
     cv::Mat labels;
-    std::vector<cv::Vec4f> planes;
+    cv::Vec3f normal = options.normal;
+    cv::Vec3f *normal_ptr = normal[0] == 0 && normal[1] == 0 && normal[2] == 0 ? nullptr : &normal;
+    double start = profiler::now_s();
+    get_planes(labels, run.planes, *points, run.thr, run.max_iters, run.desired_num_planes, run.grid_size,
+               normal_ptr, options.normal_thr, &run.stats, options.weighted, options.search);
+    run.detect_s = profiler::now_s() - start;
 
-#ifdef INFO
-    clock_t start_read_data = clock();
-    printf("Start reading point cloud data...\n");
+    run.inliers.assign(run.planes.size(), 0);
+    for (int i = 0; i < labels.rows; ++i) {
+        int label = labels.at<int>(i);
+        if (label > 0 && label <= (int) run.inliers.size()) ++run.inliers[label - 1];
+    }
+
+    if (options.write_labels) {
+        start = profiler::now_s();
+        run.label_path = label_path(options, run);
+        if (!save_points_label(run.label_path, labels, true)) {
+            run.error = "cannot write " + run.label_path;
+            run.label_path.clear();
+            return;
+        }
+        run.save_s = profiler::now_s() - start;
+    }
+    run.ok = true;
+}
+
+/*
+ * detect, with its exceptions reported as the error of the run: they must not leave the body of parallel_for
+ */
+void execute(const BatchOptions &options, Run &run) {
+    try {
+        detect(options, run);
+    } catch (const exception &e) {
+        run.ok = false;
+        run.error = e.what();
+    } catch (...) {
+        run.ok = false;
+        run.error = "unknown error";
+    }
+}
+
+void print_run(const Run &run) {
+#if !INFO
+    (void) run;
+#else
+    if (!run.ok) {
+        printf("%s: planes %d, thr %f, grid_size %f, max_iters %d failed: %s\n", run.file->path.c_str(),
+               run.desired_num_planes, run.thr, run.grid_size, run.max_iters, run.error.c_str());
+        return;
+    }
+    printf("%s: %d points, read %f s, planes %d, thr %f, grid_size %f, max_iters %d, detection %f s\n",
+           run.file->path.c_str(), run.num_points, run.file->read_s, run.desired_num_planes, run.thr, run.grid_size,
+           run.max_iters, run.detect_s);
+    const RansacStats &stats = run.stats;
+    printf("RANSAC statistics: hypotheses %lld, degenerate %lld, rejected by normal %lld, full inlier passes %lld, "
+           "early terminations %lld, local optimisation improvements %lld, points touched %lld\n",
+           stats.hypotheses, stats.degenerate, stats.normal_rejected, stats.inlier_passes,
+           stats.early_terminations, stats.lo_improvements, stats.points_touched);
+    printf("Final iteration bound per plane:");
+    for (int bound : stats.iteration_bounds) printf(" %d", bound);
+    printf("\nInliers per plane:");
+    for (int inliers : run.inliers) printf(" %d", inliers);
+    printf("\n");
+    if (!run.label_path.empty()) printf("save labels Successful, path: %s\n", run.label_path.c_str());
 #endif
+}
 
+bool write_manifest(const BatchOptions &options, const vector<Run> &runs, double total_s) {
+    ofstream ofs(options.manifest);
+    if (!ofs.is_open()) {
+        cerr << "Cannot open file " << options.manifest << endl;
+        return false;
+    }
+    pd::JsonWriter json(ofs);
+    json.begin_object()
+            .field("threads", pd::get_num_threads()).field("total_s", total_s)
+            .field("normal_thr", options.normal_thr).field("weighted", options.weighted)
+            .field("search", options.search == PD_SEARCH_PROJECTION ? "projection" :
+                            options.search == PD_SEARCH_MANHATTAN ? "manhattan" : "ransac")
+            .begin_array("normal").value(options.normal[0]).value(options.normal[1]).value(options.normal[2])
+            .end_array()
+            .begin_array("runs");
+    for (const Run &run : runs) {
+        json.begin_object()
+                .field("file", run.file->path).field("points", run.num_points).field("read_s", run.file->read_s)
+                .field("desired_num_planes", run.desired_num_planes).field("thr", (double) run.thr)
+                .field("grid_size", (double) run.grid_size).field("max_iters", run.max_iters)
+                .field("ok", run.ok);
+        if (!run.ok) json.field("error", run.error);
+        json.field("detect_s", run.detect_s).field("save_s", run.save_s)
+                .field("hypotheses", run.stats.hypotheses).field("inlier_passes", run.stats.inlier_passes)
+                .begin_array("planes");
+        for (size_t i = 0; i < run.planes.size(); ++i) {
+            const cv::Vec4f &p = run.planes[i];
+            json.begin_object()
+                    .field("a", (double) p[0]).field("b", (double) p[1]).field("c", (double) p[2])
+                    .field("d", (double) p[3]).field("inliers", run.inliers[i])
+                    .end_object();
+        }
+        json.end_array();
+        if (!run.label_path.empty()) json.field("labels", run.label_path);
+        json.end_object();
+    }
+    json.end_array().end_object();
+    return (bool) ofs;
+}
 
-    if (read_point_cloud_ply_to_mat(point_cloud, test_file_path)) {
+int main(int argc, char *argv[]) {
+
+    BatchOptions options;
+    // A number first is the legacy form, with arguments missing when it does not parse
+    double first;
+    const bool legacy = argc > 1 && parse_number(argv[1], first);
+    if (legacy ? !parse_positional(argc, argv, options) : !parse_options(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+    if (options.threads > 0) pd::set_num_threads(options.threads);
 
+    // Runs of the same file are adjacent, so a file is read once and only the files being worked on stay in memory
+    vector<unique_ptr<InputFile>> files;
+    vector<Run> runs;
+    for (const string &path : options.files) {
+        files.emplace_back(new InputFile());
+        InputFile *file = files.back().get();
+        file->path = path;
+        for (int planes : options.planes)
+            for (float thr : options.thrs)
+                for (float grid_size : options.grids)
+                    for (int iters : options.iters) {
+                        Run run;
+                        run.file = file;
+                        run.desired_num_planes = planes;
+                        run.thr = thr;
+                        run.grid_size = grid_size;
+                        run.max_iters = iters;
+                        runs.push_back(run);
+                        ++file->remaining;
+                    }
+    }
 
-#ifdef INFO
-        printf("Successfully read point cloud data, point cloud size %d, time cost %f s\n",
-               point_cloud.rows, ((float) (clock() - start_read_data)) / CLOCKS_PER_SEC);
+#if INFO
+    printf("Detecting %zu runs over %zu files on %d threads...\n", runs.size(), files.size(), pd::get_num_threads());
 #endif
-
-        cv::Vec3f normal(nor1, nor2, nor3);
-        cv::Vec3f *normal_ptr;
-        if (nor1 == 0 && nor2 == 0 && nor3 == 0) {
-            normal_ptr = nullptr;
-        } else {
-            normal_ptr = &normal;
+    // The progress of detections running at the same time would interleave, print_run reports every run instead
+    set_print_progress(runs.size() == 1);
+    double start = profiler::now_s();
+    // Every run is a sizeable piece of work; the detections inside share the same pool
+    mutex print_mutex;
+    pd::parallel_for(0, (int) runs.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            execute(options, runs[i]);
+            lock_guard<mutex> lock(print_mutex);
+            print_run(runs[i]);
         }
-        get_planes(labels, planes, point_cloud, thr, max_iters, desired_num_planes, grid_size, normal_ptr);
-        char label_path[256];
-        sprintf(label_path, "%s-thr_%4f-iter_%d-grid_size_%4f-planes-%d-label.txt",
-                test_file_path.c_str(), thr, max_iters, grid_size, desired_num_planes);
-        save_points_label(label_path, labels);
-#ifdef INFO
-        printf("save labels Successful, path: %s\n", label_path);
+    });
+    double total_s = profiler::now_s() - start;
+
+    int failed = 0;
+    for (const Run &run : runs) failed += !run.ok;
+#if INFO
+    printf("%zu runs in %f s, %d failed\n", runs.size(), total_s, failed);
+#endif
+    if (!options.manifest.empty()) {
+        if (!write_manifest(options, runs, total_s)) return 1;
+#if INFO
+        printf("save manifest Successful, path: %s\n", options.manifest.c_str());
 #endif
     }
+    if (profiler::enabled()) profiler::print_report();
+    return failed ? 1 : 0;
 }
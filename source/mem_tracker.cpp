@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include "mem_tracker.h"
+
+#ifdef PLANE_DETECTION_OPENCV
+#include <opencv2/core.hpp>
+#endif
+
+namespace mem_tracker {
+
+namespace {
+
+std::atomic<bool> tracking_enabled(false);
+std::atomic<long long> live(0), peak(0), total(0);
+
+// What the calling thread allocated and freed, scopes measure these so that scopes running at the same time on
+// other threads neither reset their peak nor add to their bytes
+thread_local long long thread_live = 0, thread_peak = 0, thread_total = 0;
+
+#ifdef PLANE_DETECTION_OPENCV
+
+/*
+ * Delegates to OpenCV's standard allocator and counts the bytes of every buffer it owns. Allocations made while
+ * accounting was disabled are not in the counters, so only buffers this allocator counted are subtracted again.
+ */
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *std_allocator) : std_(std_allocator) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usage_flags) const override {
+        cv::UMatData *u = std_->allocate(dims, sizes, type, data, step, flags, usage_flags);
+        if (u != nullptr) {
+            // Route the release back through this allocator
+            u->currAllocator = this;
+            if (!(u->flags & cv::UMatData::USER_ALLOCATED)) on_alloc(u->size);
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override {
+        return std_->allocate(data, access_flags, usage_flags);
+    }
+
+    void deallocate(cv::UMatData *u) const override {
+        if (u != nullptr && !(u->flags & cv::UMatData::USER_ALLOCATED)) on_free(u->size);
+        std_->deallocate(u);
+    }
+
+private:
+    cv::MatAllocator *std_;
+};
+
+#endif
+
+bool env_enabled() {
+    const char *env = std::getenv("PLANE_DETECTION_MEMORY");
+    return env != nullptr && std::strcmp(env, "0") != 0 && std::strcmp(env, "") != 0;
+}
+
+bool enabled_from_env = []() {
+    if (env_enabled()) set_enabled(true);
+    return true;
+}();
+
+}  // namespace
+
+void set_enabled(bool enabled) {
+#ifdef PLANE_DETECTION_OPENCV
+    static CountingMatAllocator *counting = nullptr;
+    // Mats created while the counting allocator is the default keep releasing through it, so it is never deleted
+    if (enabled && counting == nullptr && cv::Mat::getStdAllocator() != nullptr)
+        counting = new CountingMatAllocator(cv::Mat::getStdAllocator());
+    if (counting != nullptr) cv::Mat::setDefaultAllocator(enabled ? counting : nullptr);
+#endif
+    tracking_enabled = enabled;
+}
+
+bool enabled() {
+    return tracking_enabled;
+}
+
+void on_alloc(size_t bytes) {
+    total += (long long) bytes;
+    long long now = live += (long long) bytes;
+    long long old_peak = peak;
+    while (now > old_peak && !peak.compare_exchange_weak(old_peak, now)) {}
+    thread_total += (long long) bytes;
+    thread_live += (long long) bytes;
+    if (thread_live > thread_peak) thread_peak = thread_live;
+}
+
+void on_free(size_t bytes) {
+    live -= (long long) bytes;
+    thread_live -= (long long) bytes;
+}
+
+long long live_bytes() {
+    return live;
+}
+
+long long peak_live_bytes() {
+    return peak;
+}
+
+long long total_allocated_bytes() {
+    return total;
+}
+
+ScopeMark begin_scope() {
+    ScopeMark mark;
+    mark.total_at_start = thread_total;
+    mark.live_at_start = thread_live;
+    mark.outer_peak = thread_peak;
+    thread_peak = thread_live;
+    return mark;
+}
+
+void end_scope(const ScopeMark &mark, long long &allocated_bytes, long long &peak_bytes) {
+    allocated_bytes = thread_total - mark.total_at_start;
+    peak_bytes = thread_peak - mark.live_at_start;
+    // The enclosing scope sees the larger of its own peak so far and this scope's peak
+    thread_peak = std::max(mark.outer_peak, thread_peak);
+}
+
+}  // namespace mem_tracker
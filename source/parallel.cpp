@@ -0,0 +1,519 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+
+#include <sched.h>
+
+#endif
+
+namespace pd {
+
+namespace {
+
+/*
+ * Queued work and the deadline it runs under, see ScopedDeadline
+ */
+struct Task {
+    std::function<void()> run;
+    double deadline;
+};
+
+/*
+ * Tasks of one worker: the owner pushes and pops at the back, thieves take the oldest task from the front
+ */
+class WorkQueue {
+public:
+    void push(Task task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+
+    bool pop_back(Task &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.back());
+        tasks_.pop_back();
+        return true;
+    }
+
+    bool pop_front(Task &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<Task> tasks_;
+};
+
+/*
+ * Tasks of threads outside the pool, earliest deadline first and in submission order among equal deadlines
+ */
+class DeadlineQueue {
+public:
+    void push(Task task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(Entry{std::move(task), next_sequence_++});
+        std::push_heap(tasks_.begin(), tasks_.end(), later);
+    }
+
+    bool pop(Task &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        std::pop_heap(tasks_.begin(), tasks_.end(), later);
+        task = std::move(tasks_.back().task);
+        tasks_.pop_back();
+        return true;
+    }
+
+private:
+    struct Entry {
+        Task task;
+        unsigned long long sequence;
+    };
+
+    static bool later(const Entry &a, const Entry &b) {
+        if (a.task.deadline != b.task.deadline) return a.task.deadline > b.task.deadline;
+        return a.sequence > b.sequence;
+    }
+
+    std::mutex mutex_;
+    std::vector<Entry> tasks_;
+    unsigned long long next_sequence_ = 0;
+};
+
+// Deadline of the work running on this thread, inherited by the tasks it submits
+thread_local double current_deadline = std::numeric_limits<double>::infinity();
+
+void execute(Task &task) {
+    const double previous = current_deadline;
+    current_deadline = task.deadline;
+    task.run();
+    current_deadline = previous;
+}
+
+// Index of the pool worker running on this thread, -1 for other threads
+thread_local int worker_index = -1;
+
+// Parallel loops a thread outside the pool is in, it counts as running while in the outermost one
+thread_local int external_depth = 0;
+
+enum { max_nodes = 64 };
+
+/*
+ * CPU numbers of a sysfs CPU or node list such as "0-3,8-11"
+ */
+std::vector<int> parse_list(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        int first, last;
+        const size_t dash = range.find('-');
+        try {
+            first = std::stoi(range.substr(0, dash));
+            last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        } catch (const std::exception &) {
+            continue;
+        }
+        for (int v = first; v <= last; ++v) values.push_back(v);
+    }
+    return values;
+}
+
+std::string read_line(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    std::getline(ifs, line);
+    return line;
+}
+
+/*
+ * CPUs of every NUMA node with CPUs in the affinity mask of the process, read from sysfs. A single node with an
+ * empty list, meaning every CPU, where there is no NUMA information.
+ */
+const std::vector<std::vector<int>> &numa_topology() {
+    static const std::vector<std::vector<int>> topology = []() {
+        std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        const bool has_mask = sched_getaffinity(0, sizeof(mask), &mask) == 0;
+        for (int node : parse_list(read_line("/sys/devices/system/node/online"))) {
+            std::vector<int> cpus;
+            const std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+            for (int cpu : parse_list(read_line(path))) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE && (!has_mask || CPU_ISSET(cpu, &mask))) cpus.push_back(cpu);
+            }
+            if (!cpus.empty() && nodes.size() < max_nodes) nodes.push_back(cpus);
+        }
+#endif
+        if (nodes.empty()) nodes.emplace_back();
+        return nodes;
+    }();
+    return topology;
+}
+
+// 1 on, 0 off, -1 not set, PLANE_DETECTION_NUMA decides
+std::atomic<int> numa_placement_setting(-1);
+
+bool numa_placement() {
+    int setting = numa_placement_setting;
+    if (setting < 0) {
+        static const bool from_env = std::getenv("PLANE_DETECTION_NUMA") != nullptr &&
+                                     std::string(std::getenv("PLANE_DETECTION_NUMA")) == "1";
+        return from_env;
+    }
+    return setting > 0;
+}
+
+/*
+ * Work stealing pool shared by every parallel_for of the process. Workers are only ever added, up to the largest
+ * thread count requested, and sleep while there is nothing to run. Threads outside the pool submit to a shared
+ * injection queue ordered by deadline. The pool is never destroyed, so parallel_for stays usable during static destruction.
+ *
+ * Threads outside the pool running a parallel loop, such as stream runners, count against get_num_threads() like
+ * busy workers: a worker only starts a task while fewer threads than that are running. A thread waiting for its
+ * loop runs queued work, spins for a short while and then blocks, and a blocked waiter does not count.
+ *
+ * Worker i belongs to NUMA node i % nodes and, with NUMA placement on, is pinned to its CPUs. Tasks submitted to
+ * a node are only run by the workers of that node, they are never stolen.
+ */
+class ThreadPool {
+public:
+    static ThreadPool &instance() {
+        static ThreadPool *pool = new ThreadPool();
+        return *pool;
+    }
+
+    /**
+     * Grow the pool to at least num_workers workers
+     */
+    void reserve(int num_workers) {
+        num_workers = std::min(num_workers, (int) max_workers);
+        if (num_workers <= num_workers_) return;
+        std::lock_guard<std::mutex> lock(grow_mutex_);
+        for (int i = num_workers_; i < num_workers; ++i) {
+            std::thread(&ThreadPool::worker_loop, this, i).detach();
+            ++num_workers_;
+        }
+    }
+
+    void submit(std::function<void()> run) {
+        Task task{std::move(run), current_deadline};
+        if (worker_index >= 0) {
+            queues_[worker_index].push(std::move(task));
+        } else {
+            injection_.push(std::move(task));
+        }
+        ++pending_;
+        {
+            // Taking the lock orders the notification after a sleeping worker's check of pending_
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_one();
+    }
+
+    /**
+     * Queue a task for the workers of one NUMA node, they are woken by the next wake_all
+     */
+    void submit_to_node(int node, std::function<void()> run) {
+        node_queues_[node].push(Task{std::move(run), current_deadline});
+        ++node_pending_[node];
+    }
+
+    void wake_all() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_all();
+    }
+
+    /**
+     * Run one queued task on the calling thread: its own newest task, else a task of its node, else the most
+     * urgent injected task, else the oldest task stolen from another worker
+     *
+     * @return false if there was nothing to run
+     */
+    bool run_one() {
+        Task task;
+        bool found = worker_index >= 0 && queues_[worker_index].pop_back(task);
+        if (!found && worker_index >= 0) {
+            const int node = worker_index % num_nodes_;
+            if (node_queues_[node].pop_front(task)) {
+                --node_pending_[node];
+                execute(task);
+                return true;
+            }
+        }
+        if (!found) found = injection_.pop(task);
+        const int workers = num_workers_;
+        for (int i = 0; !found && i < workers; ++i) {
+            int victim = (worker_index + 1 + i) % workers;
+            if (victim != worker_index) found = queues_[victim].pop_front(task);
+        }
+        if (!found) return false;
+        --pending_;
+        execute(task);
+        return true;
+    }
+
+    /**
+     * Count a thread outside the pool as running, for the duration of its outermost parallel loop
+     */
+    void enter_external() {
+        if (worker_index < 0 && external_depth++ == 0) ++running_;
+    }
+
+    void leave_external() {
+        if (worker_index < 0 && --external_depth == 0) release();
+    }
+
+    /**
+     * Wait until unfinished drops to 0, running queued work meanwhile. Tasks that bring it to 0 call done().
+     */
+    void wait(const std::atomic<int> &unfinished) {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point spin_end = Clock::now() + std::chrono::microseconds(max_spin_us);
+        while (unfinished > 0) {
+            // Help with queued work, our own tasks included, so nested calls cannot deadlock
+            if (run_one()) {
+                spin_end = Clock::now() + std::chrono::microseconds(max_spin_us);
+                continue;
+            }
+            if (Clock::now() < spin_end) {
+                std::this_thread::yield();
+                continue;
+            }
+            // Blocked, this thread leaves its slot to a worker until its loop is done or there is work to help with
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            --running_;
+            wake_.notify_all();
+            wake_.wait(lock, [this, &unfinished]() { return unfinished == 0 || pending_ > 0; });
+            ++running_;
+            spin_end = Clock::now() + std::chrono::microseconds(max_spin_us);
+        }
+    }
+
+    /**
+     * Wake the threads waiting for a loop, called by the task that finished it
+     */
+    void done() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_all();
+    }
+
+private:
+    enum { max_workers = 256, max_spin_us = 50 };
+
+    ThreadPool() : num_workers_(0), pending_(0), running_(0), num_nodes_((int) numa_topology().size()) {
+        for (std::atomic<int> &pending : node_pending_) pending = 0;
+    }
+
+    void worker_loop(int index) {
+        worker_index = index;
+        const int node = index % num_nodes_;
+#ifdef __linux__
+        if (num_nodes_ > 1 && numa_placement()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : numa_topology()[node]) CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+#endif
+        for (;;) {
+            if (has_work(node) && claim()) {
+                const bool ran = run_one();
+                release();
+                if (ran) continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this, node]() { return has_work(node) && running_ < get_num_threads(); });
+        }
+    }
+
+    bool has_work(int node) const {
+        return pending_ > 0 || node_pending_[node] > 0;
+    }
+
+    /**
+     * Take a running slot if fewer than get_num_threads() threads run
+     */
+    bool claim() {
+        int running = running_;
+        while (running < get_num_threads()) {
+            if (running_.compare_exchange_weak(running, running + 1)) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Give a running slot back, a sleeping worker may take it for queued work
+     */
+    void release() {
+        --running_;
+        bool node_work = false;
+        for (int k = 0; k < num_nodes_; ++k) node_work = node_work || node_pending_[k] > 0;
+        if (pending_ == 0 && !node_work) return;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        // Only the workers of a node run its tasks, so all of them are woken for node work
+        if (node_work) wake_.notify_all();
+        else wake_.notify_one();
+    }
+
+    WorkQueue queues_[max_workers];
+    DeadlineQueue injection_;
+    WorkQueue node_queues_[max_nodes];
+    std::atomic<int> num_workers_, pending_;
+    std::atomic<int> running_;  // Workers running a task and threads outside the pool in a loop, blocked ones not
+    std::atomic<int> node_pending_[max_nodes];
+    const int num_nodes_;
+    std::mutex grow_mutex_, sleep_mutex_;
+    std::condition_variable wake_;
+};
+
+std::atomic<int> num_threads_setting(0);
+
+}  // namespace
+
+int available_cpus() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) return CPU_COUNT(&set);
+#endif
+    return std::max(1, (int) std::thread::hardware_concurrency());
+}
+
+int get_num_threads() {
+    static const int default_num_threads = available_cpus();
+    int n = num_threads_setting;
+    return n > 0 ? n : default_num_threads;
+}
+
+void set_num_threads(int num_threads) {
+    num_threads_setting = std::max(0, num_threads);
+}
+
+void parallel_for(int begin, int end, const std::function<void(int, int)> &body) {
+    if (begin >= end) return;
+    const int tasks = std::min(get_num_threads(), end - begin);
+    if (tasks <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+    pool.reserve(get_num_threads() - 1);
+    pool.enter_external();
+
+    // Indices are claimed one at a time by the caller and by tasks-1 pool tasks; a task that starts late finds
+    // nothing left and only signs off, but the caller must wait for it before the shared state goes away
+    std::atomic<int> next(begin), unfinished(tasks - 1);
+    auto run = [&]() {
+        for (int i = next++; i < end; i = next++) body(i, i + 1);
+    };
+    for (int t = 1; t < tasks; ++t) {
+        pool.submit([&]() {
+            run();
+            if (--unfinished == 0) ThreadPool::instance().done();
+        });
+    }
+    run();
+    pool.wait(unfinished);
+    pool.leave_external();
+}
+
+int numa_nodes() {
+    return numa_placement() ? (int) numa_topology().size() : 1;
+}
+
+ScopedDeadline::ScopedDeadline(double deadline) : previous_(current_deadline) {
+    current_deadline = deadline;
+}
+
+ScopedDeadline::~ScopedDeadline() {
+    current_deadline = previous_;
+}
+
+void set_numa_placement(bool enabled) {
+    numa_placement_setting = enabled ? 1 : 0;
+}
+
+void parallel_for_placed(int begin, int end, int size, int grain, const std::function<void(int, int)> &body) {
+    if (begin >= end) return;
+    grain = std::max(1, grain);
+    const int pieces = (int) (((long long) end - begin + grain - 1) / grain);
+    auto run_piece = [&](int j) {
+        const int piece_begin = begin + j * grain;
+        body(piece_begin, (int) std::min((long long) end, (long long) piece_begin + grain));
+    };
+    const int nodes = numa_nodes();
+    if (nodes <= 1 || pieces <= 1 || get_num_threads() <= 1) {
+        parallel_for(0, pieces, [&](int pieces_begin, int pieces_end) {
+            for (int j = pieces_begin; j < pieces_end; ++j) run_piece(j);
+        });
+        return;
+    }
+
+    // The pieces of a node are consecutive, from the first piece whose first element is on the node; element i
+    // is on node k for i >= ceil(k * size / nodes)
+    std::vector<int> node_first(nodes + 1, pieces);
+    for (int k = 0; k < nodes; ++k) {
+        const long long first_element = ((long long) k * size + nodes - 1) / nodes;
+        node_first[k] = first_element <= begin ? 0 : (int) std::min<long long>(
+                pieces, (first_element - begin + grain - 1) / grain);
+    }
+
+    // The caller only waits, so all get_num_threads() threads come from the pool, and every node needs a worker
+    const int workers = std::max(get_num_threads(), nodes);
+    ThreadPool &pool = ThreadPool::instance();
+    pool.reserve(workers);
+    pool.enter_external();
+
+    std::unique_ptr<std::atomic<int>[]> next(new std::atomic<int>[nodes]);
+    std::vector<int> node_tasks(nodes);
+    int tasks = 0;
+    for (int k = 0; k < nodes; ++k) {
+        next[k] = node_first[k];
+        node_tasks[k] = std::min(node_first[k + 1] - node_first[k], (workers - k + nodes - 1) / nodes);
+        tasks += std::max(0, node_tasks[k]);
+    }
+    std::atomic<int> unfinished(tasks);
+    for (int k = 0; k < nodes; ++k) {
+        for (int t = 0; t < node_tasks[k]; ++t) {
+            pool.submit_to_node(k, [&, k]() {
+                for (int j = next[k]++; j < node_first[k + 1]; j = next[k]++) run_piece(j);
+                if (--unfinished == 0) ThreadPool::instance().done();
+            });
+        }
+    }
+    pool.wake_all();
+    pool.wait(unfinished);
+    pool.leave_external();
+}
+
+}  // namespace pd
@@ -0,0 +1,76 @@
+#include "perf_counters.h"
+
+#ifdef __linux__
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#endif
+
+namespace perf_counters {
+
+const char *name(int counter) {
+    static const char *names[NUM_COUNTERS] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+    return counter >= 0 && counter < NUM_COUNTERS ? names[counter] : "unknown";
+}
+
+#ifdef __linux__
+
+namespace {
+
+/*
+ * One file descriptor per counter, so an unsupported counter does not take the others down with it
+ */
+struct ThreadCounters {
+    int fds[NUM_COUNTERS];
+
+    ThreadCounters() {
+        static const unsigned long long configs[NUM_COUNTERS] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < NUM_COUNTERS; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // pid 0 and cpu -1: the calling thread on any CPU
+            fds[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+    }
+
+    ~ThreadCounters() {
+        for (int fd : fds) if (fd >= 0) close(fd);
+    }
+};
+
+}  // namespace
+
+bool read(long long values[NUM_COUNTERS]) {
+    thread_local ThreadCounters counters;
+    bool any = false;
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        long long value = -1;
+        if (counters.fds[i] >= 0 && ::read(counters.fds[i], &value, sizeof(value)) != (ssize_t) sizeof(value))
+            value = -1;
+        values[i] = value;
+        any = any || value >= 0;
+    }
+    return any;
+}
+
+#else
+
+bool read(long long values[NUM_COUNTERS]) {
+    for (int i = 0; i < NUM_COUNTERS; ++i) values[i] = -1;
+    return false;
+}
+
+#endif
+
+}  // namespace perf_counters
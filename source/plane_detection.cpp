@@ -0,0 +1,134 @@
+#include "plane_detection.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <string>
+#include "detector.h"
+#include "ransac.h"
+
+static_assert(sizeof(int32_t) == sizeof(int), "labels are written as int");
+
+namespace {
+
+thread_local std::string last_error;
+
+pd_status fail(pd_status status, const std::string &message) {
+    last_error = message;
+    return status;
+}
+
+/*
+ * Copy of the fields of params that its version has, the others keep their defaults; the defaults for NULL
+ */
+void read_params(pd_params &read, const pd_params *params) {
+    pd_default_params(&read);
+    if (params == nullptr) return;
+    read.threshold = params->threshold;
+    read.max_iterations = params->max_iterations;
+    read.desired_num_planes = params->desired_num_planes;
+    read.grid_size = params->grid_size;
+    read.use_normal = params->use_normal;
+    std::copy(params->normal, params->normal + 3, read.normal);
+    read.normal_diff_thr = params->normal_diff_thr;
+    if (params->version < 2) return;
+    read.weighted = params->weighted;
+    if (params->version < 3) return;
+    read.search = params->search;
+}
+
+}
+
+void pd_init_params(pd_params *params, uint32_t version) {
+    if (params == nullptr) return;
+    params->version = version;
+    params->threshold = 0.1f;
+    params->max_iterations = 1000;
+    params->desired_num_planes = 1;
+    params->grid_size = -1.f;
+    params->use_normal = 0;
+    params->normal[0] = params->normal[1] = params->normal[2] = 0.f;
+    params->normal_diff_thr = 0.06;
+    if (version < 2) return;
+    params->weighted = 0;
+    if (version < 3) return;
+    params->search = PD_SEARCH_RANSAC;
+}
+
+pd_status pd_get_planes(const float *xyz, size_t n, size_t stride, const pd_params *params,
+                        int32_t *labels, float *planes, size_t planes_capacity, size_t *num_planes) {
+    last_error.clear();
+    pd_params read;
+    if (params != nullptr && (params->version < 1 || params->version > PD_PARAMS_VERSION))
+        return fail(PD_ERROR_INVALID_ARGUMENT, "params must be initialized with pd_default_params of a header no newer "
+                                               "than the library");
+    read_params(read, params);
+    params = &read;
+
+    const size_t packed = 3 * sizeof(float);
+    if (stride == 0) stride = packed;
+    if (xyz == nullptr)
+        return fail(PD_ERROR_INVALID_ARGUMENT, "xyz is NULL");
+    if (n < 3 || n > (size_t) INT_MAX)
+        return fail(PD_ERROR_INVALID_ARGUMENT, "n must be in [3, INT_MAX]");
+    if (stride < packed || stride % sizeof(float) != 0)
+        return fail(PD_ERROR_INVALID_ARGUMENT, "stride must be a multiple of sizeof(float), at least 3 floats");
+    std::string error;
+    const pd_status status = pd::validate_params(*params, error);
+    if (status != PD_OK)
+        return fail(status, error);
+    if (planes == nullptr || planes_capacity < (size_t) params->desired_num_planes)
+        return fail(PD_ERROR_INVALID_ARGUMENT, "planes must hold desired_num_planes planes");
+
+    try {
+        // The detector only reads its input, packed points are used in place
+        pd::PointCloud points(xyz, (int) n);
+        if (stride != packed) {
+            // The kernels walk packed points, a strided cloud is packed once
+            points = pd::PointCloud((int) n);
+            const char *src = (const char *) xyz;
+            for (size_t i = 0; i < n; ++i, src += stride) memcpy(points.point((int) i), src, packed);
+        }
+
+        std::vector<int> labels_buffer;
+        if (labels == nullptr) labels_buffer.resize(n);
+        pd::Vec3f normal(params->normal[0], params->normal[1], params->normal[2]);
+        std::vector<pd::Vec4f> planes_;
+        get_planes(labels != nullptr ? (int *) labels : labels_buffer.data(), planes_, points, params->threshold,
+                   params->max_iterations, params->desired_num_planes, params->grid_size,
+                   params->use_normal ? &normal : nullptr, params->normal_diff_thr, nullptr, params->weighted != 0,
+                   (pd_search) params->search);
+
+        if (planes_.size() > planes_capacity)
+            return fail(PD_ERROR_INTERNAL, "more planes than desired_num_planes");
+        for (size_t i = 0; i < planes_.size(); ++i)
+            for (int j = 0; j < 4; ++j) planes[4 * i + j] = planes_[i][j];
+        if (num_planes != nullptr) *num_planes = planes_.size();
+    } catch (const std::bad_alloc &) {
+        return fail(PD_ERROR_OUT_OF_MEMORY, "out of memory");
+    } catch (const std::exception &e) {
+        return fail(PD_ERROR_INTERNAL, e.what());
+    } catch (...) {
+        return fail(PD_ERROR_INTERNAL, "unknown error");
+    }
+    return PD_OK;
+}
+
+const char *pd_last_error(void) {
+    return last_error.c_str();
+}
+
+const char *pd_status_string(pd_status status) {
+    switch (status) {
+        case PD_OK:
+            return "ok";
+        case PD_ERROR_INVALID_ARGUMENT:
+            return "invalid argument";
+        case PD_ERROR_OUT_OF_MEMORY:
+            return "out of memory";
+        case PD_ERROR_INTERNAL:
+            return "internal error";
+    }
+    return "unknown status";
+}
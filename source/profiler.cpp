@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include "profiler.h"
+
+namespace profiler {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const Clock::time_point epoch = Clock::now();
+
+bool env_enabled(const char *variable) {
+    const char *env = std::getenv(variable);
+    return env != nullptr && std::strcmp(env, "0") != 0 && std::strcmp(env, "") != 0;
+}
+
+std::atomic<bool> profiling_enabled(env_enabled("PLANE_DETECTION_PROFILE") || env_enabled("PLANE_DETECTION_PERF") ||
+                                    env_enabled("PLANE_DETECTION_MEMORY"));
+std::atomic<bool> perf_counters_enabled(env_enabled("PLANE_DETECTION_PERF"));
+
+size_t env_size(const char *variable, size_t fallback) {
+    const char *env = std::getenv(variable);
+    if (env == nullptr || *env == '\0') return fallback;
+    const long long value = std::atoll(env);
+    return value > 0 ? (size_t) value : fallback;
+}
+
+std::atomic<size_t> max_thread_records(env_size("PLANE_DETECTION_PROFILE_RECORDS", 1 << 16));
+
+/*
+ * Every thread owns one buffer and is the only writer, the registry lock is only taken when a thread records
+ * for the first time, when it exits and when the buffers are read or cleared. A buffer keeps the latest
+ * max_records() records of its thread, older ones are overwritten, so a long running process with profiling
+ * or tracing enabled stays bounded.
+ */
+struct ThreadBuffer {
+    int thread = 0;
+    std::vector<StageRecord> records;
+    size_t next = 0;          // Slot overwritten next once records is full
+    long long dropped = 0;    // Records overwritten
+
+    void push(const StageRecord &record) {
+        const size_t cap = max_thread_records;
+        if (records.size() < cap) {
+            records.push_back(record);
+            return;
+        }
+        if (next >= records.size()) next = 0;
+        records[next++] = record;
+        ++dropped;
+    }
+
+    void clear() {
+        records.clear();
+        next = 0;
+        dropped = 0;
+    }
+};
+
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+ThreadBuffer retired;  // Records of the threads that exited, bounded like a thread buffer
+
+/*
+ * Hands the records of an exiting thread over to retired, so threads that come and go, such as server connections,
+ * do not leave a buffer each behind
+ */
+struct BufferOwner {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    ~BufferOwner() {
+        if (!buffer) return;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const StageRecord &record : buffer->records) retired.push(record);
+        retired.dropped += buffer->dropped;
+        registry.erase(std::remove(registry.begin(), registry.end(), buffer), registry.end());
+    }
+};
+
+int next_thread_id = 0;
+
+ThreadBuffer &local_buffer() {
+    thread_local BufferOwner owner;
+    if (!owner.buffer) {
+        owner.buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        owner.buffer->thread = next_thread_id++;
+        registry.push_back(owner.buffer);
+    }
+    return *owner.buffer;
+}
+
+void write_trace_at_exit() {
+    write_chrome_trace(std::getenv("PLANE_DETECTION_TRACE"));
+}
+
+/*
+ * Registered after the registry is constructed, so the trace is written before the buffers are destroyed
+ */
+bool trace_at_exit_registered = []() {
+    const char *path = std::getenv("PLANE_DETECTION_TRACE");
+    if (path == nullptr || *path == '\0') return false;
+    profiling_enabled = true;
+    std::atexit(write_trace_at_exit);
+    return true;
+}();
+
+}  // namespace
+
+double now_s() {
+    return std::chrono::duration<double>(Clock::now() - epoch).count();
+}
+
+void set_enabled(bool enabled) {
+    profiling_enabled = enabled;
+}
+
+bool enabled() {
+    return profiling_enabled;
+}
+
+void set_counters_enabled(bool enabled) {
+    perf_counters_enabled = enabled;
+}
+
+bool counters_enabled() {
+    return perf_counters_enabled;
+}
+
+void set_max_records(size_t records) {
+    max_thread_records = std::max<size_t>(records, 1);
+}
+
+size_t max_records() {
+    return max_thread_records;
+}
+
+long long dropped_records() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    long long dropped = retired.dropped;
+    for (auto &buffer : registry) dropped += buffer->dropped;
+    return dropped;
+}
+
+void reset() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &buffer : registry) buffer->clear();
+    retired.clear();
+}
+
+std::vector<StageRecord> records() {
+    std::vector<StageRecord> all;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        all = retired.records;
+        for (auto &buffer : registry) all.insert(all.end(), buffer->records.begin(), buffer->records.end());
+    }
+    std::stable_sort(all.begin(), all.end(),
+                     [](const StageRecord &a, const StageRecord &b) { return a.start_s < b.start_s; });
+    return all;
+}
+
+std::vector<StageStats> stage_stats() {
+    std::vector<StageStats> stats;
+    for (const StageRecord &r : records()) {
+        auto it = std::find_if(stats.begin(), stats.end(),
+                               [&](const StageStats &s) { return s.name == r.name; });
+        if (it == stats.end()) {
+            StageStats s;
+            s.name = r.name;
+            s.calls = 1;
+            s.total_s = s.min_s = s.max_s = r.duration_s;
+            std::copy(r.counters, r.counters + perf_counters::NUM_COUNTERS, s.counters);
+            s.allocated_bytes = r.allocated_bytes;
+            s.peak_bytes = r.peak_bytes;
+            stats.push_back(s);
+        } else {
+            ++it->calls;
+            it->total_s += r.duration_s;
+            it->min_s = std::min(it->min_s, r.duration_s);
+            it->max_s = std::max(it->max_s, r.duration_s);
+            for (int c = 0; c < perf_counters::NUM_COUNTERS; ++c) {
+                if (r.counters[c] < 0) continue;
+                it->counters[c] = it->counters[c] < 0 ? r.counters[c] : it->counters[c] + r.counters[c];
+            }
+            if (r.allocated_bytes >= 0) {
+                it->allocated_bytes = std::max(it->allocated_bytes, 0LL) + r.allocated_bytes;
+                it->peak_bytes = std::max(it->peak_bytes, r.peak_bytes);
+            }
+        }
+    }
+    return stats;
+}
+
+void print_report(FILE *out) {
+    std::vector<StageStats> stats = stage_stats();
+    bool any_counter = false, any_memory = false;
+    for (const StageStats &s : stats) {
+        for (long long c : s.counters) any_counter = any_counter || c >= 0;
+        any_memory = any_memory || s.allocated_bytes >= 0;
+    }
+
+    fprintf(out, "-----------------------------------------------------------------------------------------------\n");
+    fprintf(out, " Stage \t\t\t calls \t total (s) \t mean (s) \t min (s) \t max (s) ");
+    if (any_counter) {
+        for (int c = 0; c < perf_counters::NUM_COUNTERS; ++c) fprintf(out, "\t %s ", perf_counters::name(c));
+        fprintf(out, "\t IPC ");
+    }
+    if (any_memory) fprintf(out, "\t allocated (MiB) \t peak live (MiB) ");
+    fprintf(out, "\n");
+    for (const StageStats &s : stats) {
+        fprintf(out, " %-20s \t %lld \t %f \t %f \t %f \t %f ", s.name.c_str(), s.calls, s.total_s,
+                s.total_s / s.calls, s.min_s, s.max_s);
+        if (any_counter) {
+            for (long long c : s.counters) fprintf(out, "\t %lld ", c);
+            const long long cycles = s.counters[perf_counters::CYCLES];
+            const long long instructions = s.counters[perf_counters::INSTRUCTIONS];
+            if (cycles > 0 && instructions >= 0) fprintf(out, "\t %.2f ", (double) instructions / cycles);
+            else fprintf(out, "\t - ");
+        }
+        if (any_memory) {
+            fprintf(out, "\t %.3f \t\t %.3f ", s.allocated_bytes / 1048576.0, s.peak_bytes / 1048576.0);
+        }
+        fprintf(out, "\n");
+    }
+    if (counters_enabled() && !any_counter)
+        fprintf(out, " Hardware counters are not available (see /proc/sys/kernel/perf_event_paranoid)\n");
+    if (any_counter || any_memory)
+        fprintf(out, " Counters and allocations cover the thread that ran a stage, not the pool workers it used\n");
+    const long long dropped = dropped_records();
+    if (dropped > 0) fprintf(out, " %lld older records were dropped, see profiler::set_max_records\n", dropped);
+    fprintf(out, "-----------------------------------------------------------------------------------------------\n");
+}
+
+bool write_chrome_trace(const std::string &file_path) {
+    std::ofstream ofs(file_path);
+    if (!ofs.is_open()) {
+        std::cerr << "ofstream open file error!\n";
+        return false;
+    }
+
+    std::vector<StageRecord> all = records();
+    int num_threads = 0;
+    for (const StageRecord &r : all) num_threads = std::max(num_threads, r.thread + 1);
+
+    char buf[256];
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (int t = 0; t < num_threads; ++t) {
+        sprintf(buf, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                     "\"args\": {\"name\": \"thread %d\"}},\n", t, t);
+        ofs << buf;
+    }
+    for (size_t i = 0; i < all.size(); ++i) {
+        const StageRecord &r = all[i];
+        // Timestamps and durations are in microseconds
+        sprintf(buf, "{\"name\": \"%s\", \"cat\": \"plane_detection\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                     "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"index\": %d",
+                r.name, r.thread, r.start_s * 1e6, r.duration_s * 1e6, r.index);
+        ofs << buf;
+        for (int c = 0; c < perf_counters::NUM_COUNTERS; ++c) {
+            if (r.counters[c] >= 0) ofs << ", \"" << perf_counters::name(c) << "\": " << r.counters[c];
+        }
+        if (r.allocated_bytes >= 0)
+            ofs << ", \"allocated_bytes\": " << r.allocated_bytes << ", \"peak_bytes\": " << r.peak_bytes;
+        ofs << "}}" << (i + 1 < all.size() ? ",\n" : "\n");
+    }
+    ofs << "]}\n";
+    return true;
+}
+
+ScopedStage::ScopedStage(const char *name, int index)
+        : name_(name), index_(index), start_s_(0), active_(enabled()), counting_(false), tracking_(false) {
+    if (!active_) return;
+    tracking_ = mem_tracker::enabled();
+    if (tracking_) mem_mark_ = mem_tracker::begin_scope();
+    counting_ = counters_enabled() && perf_counters::read(counters_start_);
+    start_s_ = now_s();
+}
+
+ScopedStage::~ScopedStage() {
+    if (!active_) return;
+    double end_s = now_s();
+    StageRecord record;
+    std::fill(record.counters, record.counters + perf_counters::NUM_COUNTERS, -1LL);
+    record.allocated_bytes = record.peak_bytes = -1;
+    if (tracking_) mem_tracker::end_scope(mem_mark_, record.allocated_bytes, record.peak_bytes);
+    if (counting_) {
+        long long counters_end[perf_counters::NUM_COUNTERS];
+        perf_counters::read(counters_end);
+        for (int c = 0; c < perf_counters::NUM_COUNTERS; ++c) {
+            if (counters_start_[c] >= 0 && counters_end[c] >= 0)
+                record.counters[c] = counters_end[c] - counters_start_[c];
+        }
+    }
+    ThreadBuffer &buffer = local_buffer();
+    record.name = name_;
+    record.index = index_;
+    record.thread = buffer.thread;
+    record.start_s = start_s_;
+    record.duration_s = end_s - start_s_;
+    buffer.push(record);
+}
+
+}  // namespace profiler
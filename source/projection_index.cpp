@@ -0,0 +1,168 @@
+#include "projection_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include "profiler.h"
+
+namespace pd {
+
+ProjectionIndex::ProjectionIndex(const PointCloud &pts, const Vec3f &normal, const int *weights)
+        : pts_(pts), centroid_{0, 0, 0}, radius_(0) {
+    PD_PROFILE_SCOPE("projection_index");
+    const int n = pts.size();
+    const double norm = std::sqrt((double) normal[0] * normal[0] + (double) normal[1] * normal[1] +
+                                  (double) normal[2] * normal[2]);
+    for (int k = 0; k < 3; ++k) normal_[k] = norm > 0 ? (float) (normal[k] / norm) : 0.f;
+    if (n == 0) return;
+
+    std::vector<float> h(n);
+    mem_tracker::ScopedBytes h_bytes(h.capacity() * sizeof(float));
+    float lo = 0, hi = 0;
+    for (int p = 0; p < n; ++p) {
+        const float *q = pts.point(p);
+        h[p] = (float) ((double) normal_[0] * q[0] + (double) normal_[1] * q[1] + (double) normal_[2] * q[2]);
+        if (p == 0 || h[p] < lo) lo = h[p];
+        if (p == 0 || h[p] > hi) hi = h[p];
+        for (int k = 0; k < 3; ++k) centroid_[k] += q[k];
+    }
+    for (int k = 0; k < 3; ++k) centroid_[k] /= n;
+    for (int p = 0; p < n; ++p) {
+        const float *q = pts.point(p);
+        const double dx = q[0] - centroid_[0], dy = q[1] - centroid_[1], dz = q[2] - centroid_[2];
+        radius_ = std::max(radius_, dx * dx + dy * dy + dz * dz);
+    }
+    radius_ = std::sqrt(radius_);
+
+    // Bucket sort: about one point per bucket, the few points sharing a bucket are sorted in place
+    const int buckets = n;
+    const double bucket_width = hi > lo ? ((double) hi - lo) / buckets : 1;
+    std::vector<int> bucket_first(buckets + 1, 0);
+    mem_tracker::ScopedBytes bucket_bytes(bucket_first.capacity() * sizeof(int));
+    auto bucket = [&](float v) { return std::min(buckets - 1, (int) (((double) v - lo) / bucket_width)); };
+    for (int p = 0; p < n; ++p) ++bucket_first[bucket(h[p]) + 1];
+    for (int b = 0; b < buckets; ++b) bucket_first[b + 1] += bucket_first[b];
+
+    order_.resize(n);
+    std::vector<int> next(bucket_first.begin(), bucket_first.end() - 1);
+    for (int p = 0; p < n; ++p) order_[next[bucket(h[p])]++] = p;
+    for (int b = 0; b < buckets; ++b) {
+        if (bucket_first[b + 1] - bucket_first[b] > 1) {
+            std::sort(order_.begin() + bucket_first[b], order_.begin() + bucket_first[b + 1],
+                      [&](int x, int y) { return h[x] < h[y]; });
+        }
+    }
+
+    projection_.resize(n);
+    position_.resize(n);
+    weight_.resize(n);
+    tree_.assign(n + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        projection_[i] = h[order_[i]];
+        position_[order_[i]] = i;
+        weight_[i] = weights != nullptr ? weights[order_[i]] : 1;
+        tree_[i + 1] = weight_[i];
+    }
+    // Linear Fenwick construction, every node adds itself to its parent
+    for (int i = 1; i <= n; ++i) {
+        const int parent = i + (i & -i);
+        if (parent <= n) tree_[parent] += tree_[i];
+    }
+}
+
+int ProjectionIndex::prefix(int end) const {
+    int sum = 0;
+    for (int i = end; i > 0; i -= i & -i) sum += tree_[i];
+    return sum;
+}
+
+void ProjectionIndex::range(double centre, double half, int &first, int &last) const {
+    first = (int) (std::upper_bound(projection_.begin(), projection_.end(), (float) (centre - half)) -
+                   projection_.begin());
+    last = (int) (std::lower_bound(projection_.begin(), projection_.end(), (float) (centre + half)) -
+                  projection_.begin());
+    last = std::max(first, last);
+}
+
+int ProjectionIndex::count(double offset, double thr) const {
+    int first, last;
+    range(offset, thr, first, last);
+    return prefix(last) - prefix(first);
+}
+
+int ProjectionIndex::densest(double thr, double &offset) const {
+    // Windows start at every remaining point and hold the points less than 2 thr above it
+    int best = 0, window = 0, best_first = 0;
+    for (int first = 0, last = 0; first < size(); ++first) {
+        while (last < size() && projection_[last] - projection_[first] < 2 * thr) window += weight_[last++];
+        if (weight_[first] > 0 && window > best) best = window, best_first = first;
+        window -= weight_[first];
+    }
+    // The weighted median of the slab, the plane rather than the noise around it sets the offset
+    for (int i = best_first, below = 0; best > 0; ++i) {
+        below += weight_[i];
+        if (2 * below >= best) {
+            offset = projection_[i];
+            break;
+        }
+    }
+    return best;
+}
+
+void ProjectionIndex::band(const Vec4f &model, float thr, double &centre, double &half) const {
+    // m·p + d = n·p + (m - n)·(p - o) + (m - n)·o + d, with unit m pointing the same way as n
+    double m[4] = {model[0], model[1], model[2], model[3]};
+    double hom = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    if (m[0] * normal_[0] + m[1] * normal_[1] + m[2] * normal_[2] < 0) hom = -hom;
+    double deviation = 0, shift = m[3] / hom;
+    for (int k = 0; k < 3; ++k) {
+        const double dk = m[k] / hom - normal_[k];
+        deviation += dk * dk;
+        shift += dk * centroid_[k];
+    }
+    centre = -shift;
+    // Float rounding of the projections is covered by a relative margin
+    half = thr + std::sqrt(deviation) * radius_ + 1e-6 * (std::fabs(centre) + radius_);
+}
+
+int ProjectionIndex::bound(const Vec4f &model, float thr) const {
+    double centre, half;
+    band(model, thr, centre, half);
+    return count(centre, half);
+}
+
+int ProjectionIndex::inliers(const Vec4f &model, float thr, std::vector<int> &points, long long *touched) const {
+    points.clear();
+    double centre, half;
+    band(model, thr, centre, half);
+    int first, last;
+    range(centre, half, first, last);
+    const double hom = std::sqrt((double) model[0] * model[0] + (double) model[1] * model[1] +
+                                 (double) model[2] * model[2]);
+    const float a = (float) (model[0] / hom), b = (float) (model[1] / hom), c = (float) (model[2] / hom),
+            d = (float) (model[3] / hom);
+    int weight = 0;
+    for (int i = first; i < last; ++i) {
+        if (weight_[i] == 0) continue;
+        const int p = order_[i];
+        const float *q = pts_.point(p);
+        if (std::fabs(a * q[0] + b * q[1] + c * q[2] + d) < thr) {
+            points.push_back(p);
+            weight += weight_[i];
+        }
+    }
+    if (touched != nullptr) *touched += last - first;
+    return weight;
+}
+
+void ProjectionIndex::remove(const std::vector<int> &points) {
+    const int n = size();
+    for (int p : points) {
+        const int i = position_[p];
+        const int w = weight_[i];
+        if (w == 0) continue;
+        weight_[i] = 0;
+        for (int j = i + 1; j <= n; j += j & -j) tree_[j] -= w;
+    }
+}
+
+}  // namespace pd
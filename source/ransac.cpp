@@ -1,24 +1,201 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <unordered_map>
-#include <opencv2/opencv.hpp>
 #include "ransac.h"
+#include "mem_tracker.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "random.h"
+#include "ransac_kernels.h"
 
 #ifndef INFO
 #define INFO 1
 #endif
 
+static std::atomic<bool> print_progress_enabled(true);
 
-int get_plane(cv::Vec4f &best_model, bool *inliers, const cv::Mat &pts, float thr, int max_iterations,
-              cv::Vec3f *expect_normal, double normal_diff_thr);
+// QuietProgress scopes active on this thread
+static thread_local int quiet_progress = 0;
 
-bool check_same_plane(cv::Vec4f &p1, cv::Vec4f &p2, double thr);
+void set_print_progress(bool enabled) {
+    print_progress_enabled = enabled;
+}
+
+QuietProgress::QuietProgress() {
+    ++quiet_progress;
+}
+
+QuietProgress::~QuietProgress() {
+    --quiet_progress;
+}
+
+#if INFO
+/*
+ * printf of the progress of get_planes, unless turned off with set_print_progress or QuietProgress
+ */
+static void info(const char *format, ...) {
+    if (!print_progress_enabled || quiet_progress > 0) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+#endif
 
-inline bool check_same_normal(cv::Vec4f &actual_plane, cv::Vec3f &expect_normal, double thr);
+
+bool check_same_plane(const pd::Vec4f &p1, const pd::Vec4f &p2, double thr);
  
+/*
+ * x_min, x_max, y_min, y_max, z_min, z_max of a non empty cloud, per stripe in parallel
+ */
+static std::array<float, 6> cloud_bounds(const pd::PointCloud &pts) {
+    const int size = pts.size();
+    const float *myptr = pts.data();
+    const int stripes = size >= pd::parallel_min_points ?
+                        std::min(pd::get_num_threads() * 4, size / (pd::parallel_min_points / 4)) : 1;
+    std::vector<std::array<float, 6>> stripe_bounds(stripes);
+    pd::parallel_for(0, stripes, [&](int stripes_begin, int stripes_end) {
+        for (int s = stripes_begin; s < stripes_end; ++s) {
+            const int begin = (int) ((long long) size * s / stripes), end = (int) ((long long) size * (s + 1) / stripes);
+            float x_min, x_max, y_min, y_max, z_min, z_max;
+            x_max = x_min = myptr[3 * begin];
+            y_max = y_min = myptr[3 * begin + 1];
+            z_max = z_min = myptr[3 * begin + 2];
+
+            float x, y, z;
+            for (int i = begin + 1; i < end; ++i) {
+                int ii = 3 * i;
+                x = myptr[ii];
+                y = myptr[ii + 1];
+                z = myptr[ii + 2];
+
+                if (x_min > x) x_min = x;
+                if (x_max < x) x_max = x;
+
+                if (y_min > y) y_min = y;
+                if (y_max < y) y_max = y;
+
+                if (z_min > z) z_min = z;
+                if (z_max < z) z_max = z;
+            }
+            stripe_bounds[s] = {x_min, x_max, y_min, y_max, z_min, z_max};
+        }
+    });
+    std::array<float, 6> bounds = stripe_bounds[0];
+    for (const std::array<float, 6> &b : stripe_bounds) {
+        bounds[0] = std::min(bounds[0], b[0]), bounds[1] = std::max(bounds[1], b[1]);
+        bounds[2] = std::min(bounds[2], b[2]), bounds[3] = std::max(bounds[3], b[3]);
+        bounds[4] = std::min(bounds[4], b[4]), bounds[5] = std::max(bounds[5], b[5]);
+    }
+    return bounds;
+}
+
+/*
+ * Origin of the local frame get_planes works in: the centre of the bounding box when the cloud lies farther from
+ * the origin than it is wide, as georeferenced clouds do, else 0. Far from 0 the float sums of the plane fit and
+ * the offset d of a plane through the cloud carry few significant bits; in the local frame they stay about as
+ * small as the cloud, so every kernel keeps running on floats.
+ */
+static bool local_origin(const pd::PointCloud &pts, double origin[3]) {
+    origin[0] = origin[1] = origin[2] = 0;
+    if (pts.empty()) return false;
+    const std::array<float, 6> bounds = cloud_bounds(pts);
+    double centre[3], half_extent = 0, distance = 0;
+    for (int k = 0; k < 3; ++k) {
+        centre[k] = 0.5 * ((double) bounds[2 * k] + (double) bounds[2 * k + 1]);
+        half_extent = std::max(half_extent, 0.5 * ((double) bounds[2 * k + 1] - (double) bounds[2 * k]));
+        distance = std::max(distance, std::fabs(centre[k]));
+    }
+    if (distance <= half_extent) return false;
+    std::copy(centre, centre + 3, origin);
+    return true;
+}
+
+/*
+ * Plane of the local frame at origin in the global frame, d is shifted in double
+ */
+static pd::Vec4f to_global(const pd::Vec4f &plane, const double origin[3]) {
+    const double d = (double) plane[3] - (plane[0] * origin[0] + plane[1] * origin[1] + plane[2] * origin[2]);
+    return pd::Vec4f(plane[0], plane[1], plane[2], (float) d);
+}
+
+/*
+ * Suffix sums of size weights, size + 1 entries, see pd::PointWeights
+ */
+static std::vector<int> weight_tail(const int *weights, int size) {
+    std::vector<int> tail(size + 1, 0);
+    for (int p = size - 1; p >= 0; --p) tail[p] = tail[p + 1] + weights[p];
+    return tail;
+}
+
+/*
+ * Copy of pts written in the pieces of the get_inliers passes, so with NUMA placement every piece of the copy is
+ * on the node that scores it. A non null origin is subtracted in double on the way. pts itself when neither
+ * placement nor an origin asks for a copy.
+ */
+static pd::PointCloud place_on_nodes(const pd::PointCloud &pts, const double *origin = nullptr) {
+    const int size = pts.size();
+    if (origin == nullptr && (pd::numa_nodes() <= 1 || size < pd::parallel_min_points)) return pts;
+    PD_PROFILE_SCOPE("numa_place");
+    pd::PointCloud placed(size);
+    const int grain = std::max(pd::parallel_min_points / 4, size / (pd::get_num_threads() * 4));
+    pd::parallel_for_placed(0, size, size, grain, [&](int begin, int end) {
+        if (origin == nullptr) {
+            std::copy(pts.point(begin), pts.point(end), placed.point(begin));
+            return;
+        }
+        for (int p = begin; p < end; ++p) {
+            const float *src = pts.point(p);
+            float *dst = placed.point(p);
+            for (int k = 0; k < 3; ++k) dst[k] = (float) ((double) src[k] - origin[k]);
+        }
+    });
+    return placed;
+}
+
+/*
+ * The points of pts that are not inliers, in order. Both passes run in placed pieces, so the kept points stay
+ * about where they were, on the node that scores them. weights, when not nullptr, holds a weight per point and
+ * keeps those of the kept points.
+ */
+static pd::PointCloud remove_inliers(const pd::PointCloud &pts, const bool *inliers, int num_inliers,
+                                     std::vector<int> *weights = nullptr) {
+    const int size = pts.size();
+    pd::PointCloud kept(size - num_inliers);
+    const int grain = std::max(pd::parallel_min_points / 4, size / (pd::get_num_threads() * 4));
+    const int pieces = (size + grain - 1) / grain;
+    std::vector<int> piece_first(pieces + 1, 0);  // Index in kept of the first point kept from every piece
+    pd::parallel_for_placed(0, size, size, grain, [&](int begin, int end) {
+        piece_first[begin / grain + 1] = (int) std::count(inliers + begin, inliers + end, false);
+    });
+    std::partial_sum(piece_first.begin(), piece_first.end(), piece_first.begin());
+    std::vector<int> kept_weights(weights != nullptr ? size - num_inliers : 0);
+    pd::parallel_for_placed(0, size, size, grain, [&](int begin, int end) {
+        float *dst = kept.point(piece_first[begin / grain]);
+        int *dst_weight = weights != nullptr ? kept_weights.data() + piece_first[begin / grain] : nullptr;
+        for (int p = begin; p < end; ++p) {
+            if (!inliers[p]) {
+                const float *src = pts.point(p);
+                dst[0] = src[0], dst[1] = src[1], dst[2] = src[2];
+                dst += 3;
+                if (dst_weight != nullptr) *dst_weight++ = (*weights)[p];
+            }
+        }
+    });
+    if (weights != nullptr) weights->swap(kept_weights);
+    return kept;
+}
+
 /**
  * Get multiple planes
  *
- * @param labels  The label that the point belongs to a certain plane, n × 1 matrix, n is equal to the size of the input point cloud (output)
+ * @param labels  The label that the point belongs to a certain plane, n labels, n is equal to the size of the input point cloud (output)
  * @param planes  Holds the vector of plane equations, the equation is expressed as ax + by + cz + d = 0 (output)
  * @param points3d  Input point cloud data
  * @param thr  Threshold
@@ -26,159 +203,206 @@ inline bool check_same_normal(cv::Vec4f &actual_plane, cv::Vec3f &expect_normal,
  * @param desired_num_planes  Number of target planes
  * @param grid_size  Downsampling grid size, if less than or equal to 0, it means no downsampling
  * @param normal  Normal vector constraint, nullptr means no constraint is used, otherwise the detected plane normal vector satisfies the constraint
+ * @param normal_diff_thr  Tolerance of the normal vector constraint
+ * @param stats  Run statistics (output), reset at the start of the call, nullptr to skip
+ * @param weighted  Score every downsampled point by the number of points of its voxel while searching planes,
+ *                  so a coarse grid still ranks planes by the points they hold
+ * @param search  PD_SEARCH_RANSAC, PD_SEARCH_PROJECTION to find every plane from a ProjectionIndex along normal,
+ *                which needs a normal, or PD_SEARCH_MANHATTAN to find them along the manhattan_directions of the cloud
  */
-void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray &points3d,
-                float thr, int max_iterations, int desired_num_planes, float grid_size, cv::Vec3f *normal
-                , double normal_diff_thr) {
-#ifdef INFO
-    clock_t start, end, begin_time = clock();
-    printf("Begin fit plane, parameter: desired_num_planes: %d, threshold: %f, max_iterations: %d, grid_size: %f\n",
-           desired_num_planes, thr, max_iterations, grid_size);
+void get_planes(int *labels, std::vector<pd::Vec4f> &planes, const pd::PointCloud &points3d,
+                float thr, int max_iterations, int desired_num_planes, float grid_size, const pd::Vec3f *normal
+                , double normal_diff_thr, RansacStats *stats, bool weighted, pd_search search) {
+    PD_PROFILE_SCOPE("get_planes");
+#if INFO
+    double start, end, begin_time = profiler::now_s();
+    info("Begin fit plane, parameter: desired_num_planes: %d, threshold: %f, max_iterations: %d, grid_size: %f\n",
+         desired_num_planes, thr, max_iterations, grid_size);
 #endif
 
     using namespace std;
-    cv::Mat points3d_ = points3d.getMat();
-    if (points3d.isVector()) {
-        points3d_ = cv::Mat((int) points3d_.total(), 3, CV_32F, points3d_.data);
-    } else {
-        if (points3d_.channels() != 1)
-            points3d_ = points3d_.reshape(1, (int) points3d_.total()); // Convert to single channel
-        if (points3d_.rows < points3d_.cols)
-            transpose(points3d_, points3d_);
-        CV_CheckEQ(points3d_.cols, 3, "Invalid dimension of point");
-        if (points3d_.type() != CV_32F)
-            points3d_.convertTo(points3d_, CV_32F); // Use float to store data
+    if (stats != nullptr) *stats = RansacStats();
+    if (search == PD_SEARCH_PROJECTION && normal == nullptr) {
+        std::cerr << "The projection search needs a normal, using RANSAC" << std::endl;
+        search = PD_SEARCH_RANSAC;
     }
+    // Every kernel runs in the local frame, the planes go back to the frame of points3d on output
+    double origin[3];
+    const bool recentred = local_origin(points3d, origin);
+    pd::PointCloud points3d_ = place_on_nodes(points3d, recentred ? origin : nullptr);
+#if INFO
+    if (recentred) info("Working in a local frame at origin (%f, %f, %f)\n", origin[0], origin[1], origin[2]);
+#endif
 
 
-    std::vector<cv::Vec4f> planes_; // The plane found for the first time
+    std::vector<pd::Vec4f> planes_; // The plane found for the first time
 
     {
-        cv::Mat pts3d_plane_fit; // Point cloud used to find a plane every time
+        pd::PointCloud pts3d_plane_fit; // Point cloud used to find a plane every time
+        std::vector<int> voxel_counts;   // Weight of every point of pts3d_plane_fit when weighted
+        weighted = weighted && grid_size > 0;
 
 
 
         if (grid_size > 0) {
-#ifdef INFO
-            float duration;
-            start = clock();
+#if INFO
+            double duration;
+            start = profiler::now_s();
 #endif
 
-            VoxelGrid(pts3d_plane_fit, points3d_, grid_size, grid_size, grid_size);
+            VoxelGrid(pts3d_plane_fit, points3d_, grid_size, grid_size, grid_size, weighted ? &voxel_counts : nullptr);
+            pts3d_plane_fit = place_on_nodes(pts3d_plane_fit);
 
-#ifdef INFO
-            end = clock();
-            duration = ((float) (end - start)) / CLOCKS_PER_SEC;
-            printf("Sampling is completed, origin point cloud size %d, after sampling %d, time cost %f s \n",
-                   points3d_.rows, pts3d_plane_fit.rows, duration);
+#if INFO
+            end = profiler::now_s();
+            duration = end - start;
+            info("Sampling is completed, origin point cloud size %d, after sampling %d, time cost %f s \n",
+                 points3d_.size(), pts3d_plane_fit.size(), duration);
 #endif
 
         } else {
-#ifdef INFO
-            printf("Skip down sampling...\n");
+#if INFO
+            info("Skip down sampling...\n");
 #endif
             pts3d_plane_fit = points3d_;
         }
 
 
-        bool *inliers_ = new bool[pts3d_plane_fit.rows]; // Whether the marked point is an interior point
+        const int inliers_size_ = pts3d_plane_fit.size();
+        bool *inliers_ = mem_tracker::new_array<bool>(inliers_size_); // Whether the marked point is an interior point
+
+        // The projection searches index the cloud once per direction, found planes leave the indices instead of
+        // the cloud
+        std::vector<std::unique_ptr<pd::ProjectionIndex>> indices;
+        std::vector<int> index_inliers;
+        const int *index_weights = weighted ? voxel_counts.data() : nullptr;
+        if (search == PD_SEARCH_PROJECTION)
+            indices.emplace_back(new pd::ProjectionIndex(pts3d_plane_fit, *normal, index_weights));
+        if (search == PD_SEARCH_MANHATTAN) {
+            pd::Vec3f directions[3];
+            const int num_directions = manhattan_directions(directions, pts3d_plane_fit, thr, max_iterations, normal,
+                                                            normal_diff_thr, stats, index_weights);
+            for (int k = 0; k < num_directions; ++k) {
+#if INFO
+                info("Manhattan direction %d: (%f, %f, %f)\n", k + 1, directions[k][0], directions[k][1],
+                     directions[k][2]);
+#endif
+                indices.emplace_back(new pd::ProjectionIndex(pts3d_plane_fit, directions[k], index_weights));
+            }
+        }
 
 
-#ifdef INFO
-        printf("-----------------------------------------------------------------------------------------------\n");
-        printf(" No. \t\t\t\t Plane \t\t\t\t\tinliers num \t time cost (s) \n");
+#if INFO
+        info("-----------------------------------------------------------------------------------------------\n");
+        info(" No. \t\t\t\t Plane \t\t\t\t\tinliers num \t time cost (s) \n");
 #endif
 
 
         for (int num_planes = 1; num_planes <= desired_num_planes; ++num_planes) {
-            cv::Vec4f model_;
+            PD_PROFILE_SCOPE_INDEX("plane_search", num_planes);
+            pd::Vec4f model_;
 
 
-#ifdef INFO
-            start = clock();
+#if INFO
+            start = profiler::now_s();
 #endif
 
 
-            int inliers_num = get_plane(model_, inliers_, pts3d_plane_fit, thr, max_iterations, normal, normal_diff_thr);
+            int inliers_num;
+            if (!indices.empty()) {
+                // The direction with the densest slab holds the next plane
+                size_t densest = 0;
+                int densest_inls = 0;
+                for (size_t k = 0; indices.size() > 1 && k < indices.size(); ++k) {
+                    double offset;
+                    const int inls = indices[k]->densest(thr, offset);
+                    if (inls > densest_inls) densest = k, densest_inls = inls;
+                }
+                inliers_num = get_plane_indexed(model_, index_inliers, *indices[densest], thr, normal_diff_thr, stats);
+            } else {
+                inliers_num = get_plane(model_, inliers_, pts3d_plane_fit, thr, max_iterations, normal,
+                                        normal_diff_thr, stats, weighted ? voxel_counts.data() : nullptr);
+            }
             if (inliers_num == 0) break;
 
 
-#ifdef INFO
-            printf(" %d \t %fx + %fy + %fz + %f = 0\t\t %d \t\t %f \n", num_planes, model_[0], model_[1],
-                   model_[2], model_[3], inliers_num, ((float) (clock() - start)) / CLOCKS_PER_SEC);
+#if INFO
+            const pd::Vec4f global_model = to_global(model_, origin);
+            info(" %d \t %fx + %fy + %fz + %f = 0\t\t %d \t\t %f \n", num_planes, global_model[0],
+                 global_model[1], global_model[2], global_model[3], inliers_num, profiler::now_s() - start);
 #endif
 
 
             planes_.emplace_back(model_);
             if (num_planes == desired_num_planes) break;
 
-            const int pts3d_size = pts3d_plane_fit.rows;
-            cv::Mat tmp = pts3d_plane_fit.clone();
-            pts3d_plane_fit = cv::Mat(pts3d_size - inliers_num, 3, CV_32F);
-
-            const float *tmp_ptr = (float *) tmp.data;
-            float *fit_ptr = (float *) pts3d_plane_fit.data;
-
-            for (int c = 0, p = 0; p < pts3d_size; ++p) {
-                if (!inliers_[p]) {
-                    // If it is not the inner point of the known plane, add the next iteration to find a new plane
-                    int i = 3 * c, j = 3 * p;
-                    fit_ptr[i] = tmp_ptr[j];
-                    fit_ptr[i + 1] = tmp_ptr[j + 1];
-                    fit_ptr[i + 2] = tmp_ptr[j + 2];
-                    ++c;
-                }
+            // The points that are not inliers of the known plane are searched for the next plane
+            // Weighted, inliers_num is the number of points the inliers stand for
+            if (!indices.empty()) {
+                for (std::unique_ptr<pd::ProjectionIndex> &index : indices) index->remove(index_inliers);
+            } else if (weighted) {
+                const int removed = (int) std::count(inliers_, inliers_ + pts3d_plane_fit.size(), true);
+                pts3d_plane_fit = remove_inliers(pts3d_plane_fit, inliers_, removed, &voxel_counts);
+            } else {
+                pts3d_plane_fit = remove_inliers(pts3d_plane_fit, inliers_, inliers_num);
             }
         }
-        delete[] inliers_;
+        mem_tracker::delete_array(inliers_, inliers_size_);
     }
 
 
-#ifdef INFO
-    printf("-----------------------------------------------------------------------------------------------\n");
-    printf("Start optimizing the plane model\n");
-    clock_t opt_time_start = clock();
-    printf("-----------------------------------------------------------------------------------------------\n");
-    printf(" No. \t\t\t\t Plane \t\t\t\t\tinliers num \t time cost (s) \n");
+#if INFO
+    info("-----------------------------------------------------------------------------------------------\n");
+    info("Start optimizing the plane model\n");
+    double opt_time_start = profiler::now_s();
+    info("-----------------------------------------------------------------------------------------------\n");
+    info(" No. \t\t\t\t Plane \t\t\t\t\tinliers num \t time cost (s) \n");
 #endif
 
 
     //  According to the obtained plane model, perform local optimization on the origin cloud data and label it
+    PD_PROFILE_SCOPE("refine_planes");
     int max_lo_inliers = 300, max_lo_iters = 3;
-    int pts_size = points3d_.rows;
-    labels = cv::Mat::zeros(pts_size, 1, CV_32S);
+    int pts_size = points3d_.size();
+    std::fill(labels, labels + pts_size, 0);
 
     // Keep the index array of the point corresponding to the original point
-    int *orig_pts_idx = new int[pts_size];
+    const int orig_pts_size = pts_size;
+    int *orig_pts_idx = mem_tracker::new_array<int>(orig_pts_size);
     for (int i = 0; i < pts_size; ++i) orig_pts_idx[i] = i;
 
-    bool *inliers = new bool[pts_size];
-    cv::Vec4f lo_model, best_model;
+    bool *inliers = mem_tracker::new_array<bool>(orig_pts_size);
+    pd::Vec4f lo_model, best_model;
 
     // Store the number of points in the plane, the subscript starts from 1 in descending order
     vector<int> plane_inls_num = {0};
+    // Label of every plane of planes, in the order the planes were found
+    vector<int> found_order;
 
-    int *labels_ptr = (int *) labels.data;
-    int *inlier_sample = new int[max_lo_inliers];
+    int *labels_ptr = labels;
+    pd::Rng rng;
+    int *inlier_sample = mem_tracker::new_array<int>(max_lo_inliers);
 
     int planes_cnt = (int) planes_.size();
     for (int plane_num = 1; plane_num <= planes_cnt; ++plane_num) {
+        PD_PROFILE_SCOPE_INDEX("refinement", plane_num);
 
 
-#ifdef INFO
-        start = clock();
+#if INFO
+        start = profiler::now_s();
 #endif
 
 
         best_model = planes_[plane_num - 1];
-        pts_size = points3d_.rows;
+        pts_size = points3d_.size();
         std::vector<int> random_pool(pts_size);
+        mem_tracker::ScopedBytes random_pool_bytes(random_pool.capacity() * sizeof(int));
         for (int p = 0; p < pts_size; ++p) random_pool[p] = p;
 
-        int best_inls = get_inliers(inliers, best_model, points3d_, thr);
+        int best_inls = get_inliers(inliers, best_model, points3d_, thr, 0, stats);
         int lo_inls = 0;
         for (int lo_iter = 0; lo_iter < max_lo_iters; ++lo_iter) {
-            cv::randShuffle(random_pool);
+            pd::shuffle(random_pool, rng);
             int sample_cnt = 0;
             for (int p : random_pool) {
                 if (inliers[p]) {
@@ -193,12 +417,13 @@ void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray
 
             if (normal != nullptr)
             {
-                if (!check_same_normal(lo_model, *normal, normal_diff_thr))
+                if (!pd::same_normal(lo_model, *normal, normal_diff_thr))
                     continue;
             }
 
-            lo_inls = get_inliers(inliers, lo_model, points3d_, thr, best_inls);
+            lo_inls = get_inliers(inliers, lo_model, points3d_, thr, best_inls, stats);
             if (best_inls < lo_inls) {
+                if (stats != nullptr) ++stats->lo_improvements;
                 best_model = lo_model;
                 best_inls = lo_inls;
             } else if (best_inls == lo_inls) {
@@ -206,23 +431,25 @@ void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray
             }
         }
 
-        if (best_inls >= lo_inls) best_inls = get_inliers(inliers, best_model, points3d_, thr);
+        if (best_inls >= lo_inls) best_inls = get_inliers(inliers, best_model, points3d_, thr, 0, stats);
 
         int e = 0;
         while (best_inls < plane_inls_num[e]) ++e;
         plane_inls_num.insert(plane_inls_num.begin() + e, best_inls);
+        found_order.insert(found_order.begin() + e, plane_num);
 
-        planes.insert(planes.begin() + e, best_model);
+        const pd::Vec4f global_model = to_global(best_model, origin);
+        planes.insert(planes.begin() + e, global_model);
 
 
-#ifdef INFO
-        printf(" %d \t %fx + %fy + %fz + %f = 0 \t\t %d \t\t %f \n", plane_num, best_model[0], best_model[1],
-               best_model[2], best_model[3], best_inls, ((float) (clock() - start)) / CLOCKS_PER_SEC);
+#if INFO
+        info(" %d \t %fx + %fy + %fz + %f = 0 \t\t %d \t\t %f \n", plane_num, global_model[0], global_model[1],
+             global_model[2], global_model[3], best_inls, profiler::now_s() - start);
 #endif
 
 
-        cv::Mat tmp = points3d_;
-        const int pts3d_size = tmp.rows;
+        pd::PointCloud tmp = points3d_;
+        const int pts3d_size = tmp.size();
         if (plane_num == planes_cnt) {
             for (int c = 0, p = 0; p < pts3d_size; ++p) {
                 if (inliers[p])
@@ -231,18 +458,12 @@ void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray
             break;
         }
 
-        points3d_ = cv::Mat(pts3d_size - best_inls, 3, CV_32F);
+        points3d_ = remove_inliers(tmp, inliers, best_inls);
 
-        const float *tmp_ptr = (float *) tmp.data;
-        float *pts3d_ptr_ = (float *) points3d_.data;
         for (int c = 0, p = 0; p < pts3d_size; ++p) {
             if (!inliers[p]) {
                 // If the point is not in the found plane, add it to the next run
                 orig_pts_idx[c] = orig_pts_idx[p];
-                int i = 3 * c, j = 3 * p;
-                pts3d_ptr_[i] = tmp_ptr[j];
-                pts3d_ptr_[i + 1] = tmp_ptr[j + 1];
-                pts3d_ptr_[i + 2] = tmp_ptr[j + 2];
                 ++c;
             } else {
                 labels_ptr[orig_pts_idx[p]] = plane_num; // Otherwise mark this point
@@ -250,17 +471,24 @@ void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray
         }
     }
 
+    // planes is sorted by inliers, renumber the labels so that label k is the plane planes[k - 1]
+    if (!std::is_sorted(found_order.begin(), found_order.end())) {
+        vector<int> label_of(found_order.size() + 1, 0);
+        for (int i = 0; i < (int) found_order.size(); ++i) label_of[found_order[i]] = i + 1;
+        for (int i = 0; i < orig_pts_size; ++i) labels[i] = label_of[labels[i]];
+    }
 
-#ifdef INFO
-    printf("-----------------------------------------------------------------------------------------------\n");
-    printf("Optimization time cost: %f s\n", ((float) (clock() - opt_time_start)) / CLOCKS_PER_SEC);
-    printf("Total time of plane fitting: %f s\n", ((float) (clock() - begin_time)) / CLOCKS_PER_SEC);
+
+#if INFO
+    info("-----------------------------------------------------------------------------------------------\n");
+    info("Optimization time cost: %f s\n", profiler::now_s() - opt_time_start);
+    info("Total time of plane fitting: %f s\n", profiler::now_s() - begin_time);
 #endif
 
 
-    delete[] orig_pts_idx;
-    delete[] inliers;
-    delete[] inlier_sample;
+    mem_tracker::delete_array(orig_pts_idx, orig_pts_size);
+    mem_tracker::delete_array(inliers, orig_pts_size);
+    mem_tracker::delete_array(inlier_sample, max_lo_inliers);
 }
 
 /**
@@ -271,37 +499,24 @@ void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray
  * @param length  Square length
  * @param width  Square width
  * @param height  Square height
+ * @param counts  Number of points in the voxel of every sample (output), nullptr to skip
  * @return
  */
 // 体素采样 根据所有点云的最大最小坐标范围 体素块大小 分割体素块 用字典表示 字典键为体素标号(三个坐标) 值为在该体素块内的点云序号
 // 计算体素块内的平均坐标，遍历体素块内的点云与平均坐标最近点作为该体素的采样
-bool VoxelGrid(cv::Mat &sampling_pts, cv::Mat &pts, float length, float width, float height) {
-    const int size = pts.rows;
+bool VoxelGrid(pd::PointCloud &sampling_pts, const pd::PointCloud &pts, float length, float width, float height,
+               std::vector<int> *counts) {
+    PD_PROFILE_SCOPE("voxelize");
+    const int size = pts.size();
     using namespace std;
-    float *myptr = (float *) pts.data;
-    float x_min, x_max, y_min, y_max, z_min, z_max;
-    x_max = x_min = myptr[0];
-    y_max = y_min = myptr[1];
-    z_max = z_min = myptr[2];
-
-    float x, y, z;
-    for (int i = 1; i < size; ++i) {
-        int ii = 3 * i;
-        x = myptr[ii];
-        y = myptr[ii + 1];
-        z = myptr[ii + 2];
+    const float *myptr = pts.data();
 
-        if (x_min > x) x_min = x;
-        if (x_max < x) x_max = x;
+    std::array<float, 6> bounds = cloud_bounds(pts);
+    const float x_min = bounds[0], y_min = bounds[2], z_min = bounds[4];
 
-        if (y_min > y) y_min = y;
-        if (y_max < y) y_max = y;
-
-        if (z_min > z) z_min = z;
-        if (z_max < z) z_max = z;
-    }   // find the minimum and maximum of xyz
-
-    unordered_map<string, vector<int>> grids;  // 字典键为体素标号(三个坐标) 值为在该体素块内的点云序号
+    typedef vector<int, mem_tracker::CountingAllocator<int>> Cluster;
+    unordered_map<string, Cluster, hash<string>, equal_to<string>,
+            mem_tracker::CountingAllocator<pair<const string, Cluster>>> grids;  // 字典键为体素标号(三个坐标) 值为在该体素块内的点云序号
 
     int init_size = size * 0.02;
     grids.reserve(init_size);
@@ -321,276 +536,217 @@ bool VoxelGrid(cv::Mat &sampling_pts, cv::Mat &pts, float length, float width, f
             grids[buff].push_back(i);
     }
 
-    sampling_pts = cv::Mat((int) grids.size(), 3, CV_32F);
-
-
-    float *sampling_ptr = sampling_pts.ptr<float>();
-
-    int label_id = 0;
-    for (auto &grid : grids) {
-        int cluster_size = (int) grid.second.size();
-        float sumx = 0, sumy = 0, sumz = 0;
-        float **block = new float *[cluster_size];
-        for (int j = 0; j < cluster_size; ++j) {
-            block[j] = new float[3];
-            float *pts_ptr = pts.ptr<float>(grid.second[j]);
-            block[j][0] = *pts_ptr;
-            ++pts_ptr;
-            block[j][1] = *pts_ptr;
-            ++pts_ptr;
-            block[j][2] = *pts_ptr;
-            sumx += block[j][0];
-            sumy += block[j][1];
-            sumz += block[j][2];
-        }
-        float x_center = sumx / cluster_size, y_center = sumy / cluster_size, z_center = sumz / cluster_size;
-        float x_sample = block[0][0], y_sample = block[0][1], z_sample = block[0][2];
-        float min_dist = (x_sample - x_center) * (x_sample - x_center) +
-                         (y_sample - y_center) * (y_sample - y_center) +
-                         (z_sample - z_center) * (z_sample - z_center);
-        for (int j = 1; j < cluster_size; ++j) {
-            float tmp_dist = (block[j][0] - x_center) * (block[j][0] - x_center) +
-                             (block[j][1] - y_center) * (block[j][1] - y_center) +
-                             (block[j][2] - z_center) * (block[j][2] - z_center);
-            if (tmp_dist < min_dist) {
-                min_dist = tmp_dist;
-                x_sample = block[j][0];
-                y_sample = block[j][1];
-                z_sample = block[j][2];
+    sampling_pts = pd::PointCloud((int) grids.size());
+
+
+    float *sampling_ptr = sampling_pts.data();
+
+    // Every voxel picks its sample independently, in parallel stripes over the voxels in map order
+    std::vector<const Cluster *> clusters;
+    clusters.reserve(grids.size());
+    for (auto &grid : grids) clusters.push_back(&grid.second);
+    const int num_clusters = (int) clusters.size();
+    if (counts != nullptr) counts->resize(num_clusters);
+    const int cluster_stripes = std::max(1, std::min(pd::get_num_threads() * 4, num_clusters / 1024));
+    pd::parallel_for(0, cluster_stripes, [&](int stripes_begin, int stripes_end) {
+        for (int s = stripes_begin; s < stripes_end; ++s) {
+            const int label_begin = (int) ((long long) num_clusters * s / cluster_stripes);
+            const int label_end = (int) ((long long) num_clusters * (s + 1) / cluster_stripes);
+            for (int label_id = label_begin; label_id < label_end; ++label_id) {
+                const Cluster &cluster = *clusters[label_id];
+                int cluster_size = (int) cluster.size();
+                float sumx = 0, sumy = 0, sumz = 0;
+                float **block = mem_tracker::new_array<float *>(cluster_size);
+                for (int j = 0; j < cluster_size; ++j) {
+                    block[j] = mem_tracker::new_array<float>(3);
+                    const float *pts_ptr = pts.point(cluster[j]);
+                    block[j][0] = *pts_ptr;
+                    ++pts_ptr;
+                    block[j][1] = *pts_ptr;
+                    ++pts_ptr;
+                    block[j][2] = *pts_ptr;
+                    sumx += block[j][0];
+                    sumy += block[j][1];
+                    sumz += block[j][2];
+                }
+                float x_center = sumx / cluster_size, y_center = sumy / cluster_size, z_center = sumz / cluster_size;
+                float x_sample = block[0][0], y_sample = block[0][1], z_sample = block[0][2];
+                float min_dist = (x_sample - x_center) * (x_sample - x_center) +
+                                 (y_sample - y_center) * (y_sample - y_center) +
+                                 (z_sample - z_center) * (z_sample - z_center);
+                for (int j = 1; j < cluster_size; ++j) {
+                    float tmp_dist = (block[j][0] - x_center) * (block[j][0] - x_center) +
+                                     (block[j][1] - y_center) * (block[j][1] - y_center) +
+                                     (block[j][2] - z_center) * (block[j][2] - z_center);
+                    if (tmp_dist < min_dist) {
+                        min_dist = tmp_dist;
+                        x_sample = block[j][0];
+                        y_sample = block[j][1];
+                        z_sample = block[j][2];
+                    }
+                }
+
+                for (int _ = 0; _ < cluster_size; ++_) {
+                    mem_tracker::delete_array(block[_], 3);
+                }
+                mem_tracker::delete_array(block, cluster_size);
+
+                if (counts != nullptr) (*counts)[label_id] = cluster_size;
+                float *dst = sampling_ptr + 3 * label_id;
+                dst[0] = x_sample;
+                dst[1] = y_sample;
+                dst[2] = z_sample;
             }
         }
+    });
 
-        for (int _ = 0; _ < cluster_size; ++_) {
-            delete[] block[_];
-        }
-        delete[]block;
+    return true;
+}
 
-        *sampling_ptr = x_sample;
-        ++sampling_ptr;
-        *sampling_ptr = y_sample;
-        ++sampling_ptr;
-        *sampling_ptr = z_sample;
-        ++sampling_ptr;
+bool total_least_squares_plane_estimate(pd::Vec4f &model, const pd::PointCloud &input, const int *sample,
+                                        int sample_num) {
+    return pd::total_least_squares_plane_estimate(model, input.span(), sample, sample_num);
+}
 
+int get_inliers(bool *inliers, const pd::Vec4f &model, const pd::PointCloud &pts, float thr, int best_inls,
+                RansacStats *stats) {
+    // Without a best model there is nothing to prune against
+    if (best_inls > 0) return pd::get_inliers<pd::Pruning>(inliers, model, pts.span(), thr, best_inls, stats);
+    return pd::get_inliers<pd::NoPruning>(inliers, model, pts.span(), thr, 0, stats);
+}
 
-        ++label_id;
+int get_plane(pd::Vec4f &best_model, bool *inliers, const pd::PointCloud &pts, float thr, int max_iterations,
+              const pd::Vec3f *normal, double normal_diff_thr, RansacStats *stats, const int *weights) {
+    pd::UniformSampler sampler;
+    if (weights != nullptr) {
+        const std::vector<int> tail = weight_tail(weights, pts.size());
+        const pd::PointWeights point_weights = {weights, tail.data()};
+        if (normal != nullptr)
+            return pd::get_plane<pd::Pruning>(best_model, inliers, pts.span(), thr, max_iterations,
+                                              pd::NormalConstraint(*normal, normal_diff_thr), sampler, stats,
+                                              point_weights);
+        return pd::get_plane<pd::Pruning>(best_model, inliers, pts.span(), thr, max_iterations,
+                                          pd::NoNormalConstraint(), sampler, stats, point_weights);
     }
-
-    return true;
+    if (normal != nullptr)
+        return pd::get_plane<pd::Pruning>(best_model, inliers, pts.span(), thr, max_iterations,
+                                          pd::NormalConstraint(*normal, normal_diff_thr), sampler, stats);
+    return pd::get_plane<pd::Pruning>(best_model, inliers, pts.span(), thr, max_iterations, pd::NoNormalConstraint(),
+                                      sampler, stats);
 }
 
-/**
- * Select some points to fit a plane
- *
- * @param model  Fitted plane model results (output) ax + by + cz + d = 0
- *
- * @param input  Input point cloud
- * @param sample  The point used to fit the plane is the data subscript in the input, the first sample_num is valid
- * @param sample_num  The number of points used to fit the plane
- * @return is the fitting result valid
- */
-// 最佳拟合平面使用最小二乘特征值分解的方法求解
-// 具体是总体最小二乘法(Total Least Square, TLS)可求解特殊平面
-bool total_least_squares_plane_estimate(cv::Vec4f &model, const cv::Mat &input, const int *sample, int sample_num) {
-    const float *pts_ptr = (float *) input.data;
-
-    // Judging the collinearity of three points
-    if (3 == sample_num) {
-        int id1 = 3 * sample[0], id2 = 3 * sample[1], id3 = 3 * sample[2];
-        float x1 = pts_ptr[id1], y1 = pts_ptr[id1 + 1], z1 = pts_ptr[id1 + 2];
-        float x2 = pts_ptr[id2], y2 = pts_ptr[id2 + 1], z2 = pts_ptr[id2 + 2];
-        float x3 = pts_ptr[id3], y3 = pts_ptr[id3 + 1], z3 = pts_ptr[id3 + 2];
-        cv::Vec3f ba(x1 - x2, y1 - y2, z1 - z2);
-        cv::Vec3f ca(x1 - x3, y1 - y3, z1 - z3);
-        float ba_dot_ca = fabs(ca.dot(ba));
-        if (fabs(ba_dot_ca * ba_dot_ca - ba.dot(ba) * ca.dot(ca)) < 0.0001) {
-            return false;
-        }
+int get_plane_indexed(pd::Vec4f &best_model, std::vector<int> &inliers, const pd::ProjectionIndex &index, float thr,
+                      double normal_diff_thr, RansacStats *stats) {
+    PD_PROFILE_SCOPE("get_plane_indexed");
+    const int max_refits = 3, max_fit_points = 1000;
+    const pd::Vec3f &normal = index.normal();
+    long long touched = 0;
+    double offset;
+    int best_inls = index.densest(thr, offset);
+    inliers.clear();
+    if (best_inls > 0) {
+        best_model = pd::Vec4f(normal[0], normal[1], normal[2], (float) -offset);
+        if (stats != nullptr) ++stats->hypotheses;
+        best_inls = index.inliers(best_model, thr, inliers, &touched);
     }
-    float sum_x = 0, sum_y = 0, sum_z = 0;
-    for (int i = 0; i < sample_num; ++i) {
-        int ii = 3 * sample[i];
-        sum_x += pts_ptr[ii];
-        sum_y += pts_ptr[ii + 1];
-        sum_z += pts_ptr[ii + 2];
-    }
-
-    const float mean_x = sum_x / sample_num, mean_y = sum_y / sample_num, mean_z = sum_z / sample_num;
 
-    cv::Mat pd_mat;
-    {
-        cv::Mat U(sample_num, 3, CV_32F);
-        cv::Mat UT(3, sample_num, CV_32F);
-        float *U_ptr = (float *) U.data;
-        float *UT_ptr = (float *) UT.data;
-        int d_size = sample_num + sample_num;
-        for (int i = 0; i < sample_num; ++i) {
-            int ii = 3 * sample[i], j = 3 * i;
-            UT_ptr[i] = U_ptr[j] = pts_ptr[ii] - mean_x;
-            UT_ptr[i + sample_num] = U_ptr[j + 1] = pts_ptr[ii + 1] - mean_y;
-            UT_ptr[i + d_size] = U_ptr[j + 2] = pts_ptr[ii + 2] - mean_z;
+    // Refit the tilt on a stride of the inliers; a refit whose band cannot hold as many inliers is not counted. A fit
+    // as good as the slab replaces it, its offset is the least squares one rather than the middle of the slab
+    std::vector<int> fit_points, refit_inliers;
+    for (int refit = 0; refit < max_refits && best_inls > 0; ++refit) {
+        const int stride = std::max(1, (int) inliers.size() / max_fit_points);
+        fit_points.clear();
+        for (size_t i = 0; i < inliers.size(); i += stride) fit_points.push_back(inliers[i]);
+        pd::Vec4f model;
+        if (stats != nullptr) ++stats->hypotheses;
+        if (!total_least_squares_plane_estimate(model, index.points(), fit_points.data(), (int) fit_points.size())) {
+            if (stats != nullptr) ++stats->degenerate;
+            break;
         }
-
-        pd_mat = UT * U;
+        if (!pd::same_normal(model, normal, normal_diff_thr)) {
+            if (stats != nullptr) ++stats->normal_rejected;
+            break;
+        }
+        if (index.bound(model, thr) < best_inls) {
+            if (stats != nullptr) ++stats->early_terminations;
+            break;
+        }
+        const int inls = index.inliers(model, thr, refit_inliers, &touched);
+        if (inls < best_inls) break;
+        const bool improved = inls > best_inls;
+        if (improved && stats != nullptr) ++stats->lo_improvements;
+        best_model = model;
+        best_inls = inls;
+        inliers.swap(refit_inliers);
+        if (!improved) break;
     }
-
-    cv::Mat eigenvalues;
-    cv::Mat eigenvectors(3, 3, CV_32F);
-    cv::eigen(pd_mat, eigenvalues, eigenvectors); //计算特征值特征向量
-    const float *eig_ptr = (float *) eigenvectors.data;
-
-    float a = eig_ptr[6], b = eig_ptr[7], c = eig_ptr[8];
-    if (std::isinf(a) || std::isinf(b) || std::isinf(c) || (a == 0 && b == 0 && c == 0)) {
-        std::cerr << "tls estimate plane fail." << std::endl;
-        return false;
+    if (stats != nullptr) {
+        stats->points_touched += touched;
+        stats->iteration_bounds.push_back(1);
     }
-
-    model = cv::Vec4f(a, b, c, -a * mean_x - b * mean_y - c * mean_z);
-    return true;
+    return best_inls;
 }
 
-/**
- * Get points in the plane
- *
- * @param inliers  Mark whether it is the inner point of the input plane (output)
- *
- * @param model  Plane model
- * @param pts  Point cloud
- * @param thr  Threshold, the point is considered to belong to the plane if the distance from the point to the plane is less than the threshold
- * @param best_inls  The number of interior points of the best model. If there is no chance that the number of interior points is greater than this value, the calculation will be terminated
- * @return number of points
- */
-// 这里有一个剪枝策略 就是先计算2/3的点数 对于后1/3的点当前平面内点数+未遍历点数<最佳平面点数 则该平面不是最佳平面 可忽略
-int get_inliers(bool *inliers, const cv::Vec4f &model, const cv::Mat &pts, float thr, int best_inls) {
-    const int pts_size = pts.rows;
-    const float *pts_ptr = (float *) pts.data;
-    float a = model(0), b = model(1), c = model(2), d = model(3), hom = sqrt(a * a + b * b + c * c);
-    a = a / hom, b = b / hom, c = c / hom, d = d / hom;
-
-    int num_inliers = 0;
-
-    std::fill(inliers, inliers + pts_size, false);//将一个区间的元素都赋予指定的值，即在[first, last)范围内填充指定值。
-    // According to statistical estimation, the calculation of the first 2/3 of the points is necessary and cannot be pruned
-    int cut = pts_size * 2 / 3;
-    for (int p = 0; p < cut; ++p) {
-        int pp = 3 * p;
-        if (fabs(a * pts_ptr[pp] + b * pts_ptr[pp + 1] + c * pts_ptr[pp + 2] + d) < thr) {
-            inliers[p] = true;
-            ++num_inliers;
+int manhattan_directions(pd::Vec3f directions[3], const pd::PointCloud &pts, float thr, int max_iterations,
+                         const pd::Vec3f *normal, double normal_diff_thr, RansacStats *stats, const int *weights) {
+    // A stride of the points is enough to find the directions
+    const int max_points = 20000;
+    if (pts.size() > max_points) {
+        const int stride = (pts.size() + max_points - 1) / max_points;
+        pd::PointCloud sample((pts.size() + stride - 1) / stride);
+        std::vector<int> sample_weights(weights != nullptr ? sample.size() : 0);
+        for (int i = 0; i < sample.size(); ++i) {
+            std::copy(pts.point(i * stride), pts.point(i * stride) + 3, sample.point(i));
+            if (weights != nullptr) sample_weights[i] = weights[i * stride];
         }
+        return manhattan_directions(directions, sample, thr, max_iterations, normal, normal_diff_thr, stats,
+                                    weights != nullptr ? sample_weights.data() : nullptr);
     }
-    // prune
-    for (int p = cut; p < pts_size; ++p) {
-        int pp = 3 * p;
-        if (fabs(a * pts_ptr[pp] + b * pts_ptr[pp + 1] + c * pts_ptr[pp + 2] + d) < thr) {
-            inliers[p] = true;
-            ++num_inliers;
-        }
-        // If the uncalculated points are all interior points and the model cannot be better than the best model, then terminate the calculation
-        if (num_inliers + pts_size - p < best_inls) break;
+    PD_PROFILE_SCOPE("manhattan_directions");
+    const int size = pts.size();
+    if (size < 3) return 0;
+    bool *inliers = mem_tracker::new_array<bool>(size);
+    pd::Vec4f plane;
+    double axis[3] = {0, 0, 0};
+    if (normal != nullptr) {
+        for (int k = 0; k < 3; ++k) axis[k] = (*normal)[k];
+    } else if (get_plane(plane, inliers, pts, thr, max_iterations, nullptr, normal_diff_thr, stats, weights) > 0) {
+        for (int k = 0; k < 3; ++k) axis[k] = plane[k];
     }
-    return num_inliers;
-}
-
-/**
- * Obtain a plane
- *
- * @param best_model  The best plane model (output)
- * @param inliers  Mark whether it is the inner point of the plane model (output)
- *
- * @param pts  Point cloud
- * @param thr  Threshold
- * @param max_iterations  Maximum number of iterations
- * @return number of points
- */
-// 使用ransac算法进行最佳平面求解
-/*
-* 1. 随机选三个点，拟合平面
-* 2. 基于阈值计算平面内点数，当大于最佳平面内点数时，记为最佳平面
-*    若有预期法向，则当计算法向与预期法相相差较大时，重新计算跳过后面步骤
-* 3. 使用local ransac算法, 随机若干(20)采样内点，计算新平面, 若新内点个数超过最佳内点个数模型，则记为最佳平面
-* 4. 根据最佳内点个数，总点数，概率0.95以及最少拟合平面点数(3),计算最大迭代次数
-*/
-int
-get_plane(cv::Vec4f &best_model, bool *inliers, const cv::Mat &pts, float thr,
-          int max_iterations, cv::Vec3f *normal, double normal_diff_thr) {
-    using namespace std;
-    const int pts_size = pts.rows, min_sample_size = 3, max_lo_inliers = 20, max_lo_iters = 10;
-    if (pts_size < 3) return 0;
-
-    cv::Vec4f model, lo_model;
-    std::vector<int> random_pool(pts_size);
-    for (int p = 0; p < pts_size; ++p) random_pool[p] = p;
-
-    cv::RNG rng;
-    int *min_sample = new int[min_sample_size];
-    int *inlier_sample = new int[max_lo_inliers];
-    int best_inls = 0, num_inliers = 0;
-
-    for (int iter = 0; iter < max_iterations; ++iter) {
-        // Randomly select some points from the point cloud to fit the plane
-        for (int i = 0; i < min_sample_size; ++i) min_sample[i] = rng.uniform(0, pts_size);
-
-        if (!total_least_squares_plane_estimate(model, pts, min_sample, min_sample_size)) continue;
-
-        if(normal != nullptr){
-            if(!check_same_normal(model, *normal, normal_diff_thr)) continue;
-        }
-
-        num_inliers = get_inliers(inliers, model, pts, thr, best_inls);
-
-        if (num_inliers > best_inls) {
-
-            // The best model preserved so far
-            best_model = model;
-            best_inls = num_inliers;
-
-            // Local Optimization
-            for (int lo_iter = 0; lo_iter < max_lo_iters; ++lo_iter) {
-                cv::randShuffle(random_pool);
-
-                // Randomly select some points from the interior points to fit the plane
-                int sample_cnt = 0;
-                for (int p : random_pool) {
-                    if (inliers[p]) {
-                        inlier_sample[sample_cnt] = p;
-                        ++sample_cnt;
-                        if (sample_cnt >= max_lo_inliers) break;
-                    }
-                }
-
-                if (!total_least_squares_plane_estimate(lo_model, pts, inlier_sample, sample_cnt))
-                    continue;
-
-                if (normal != nullptr) {
-                    if (!check_same_normal(lo_model, *normal, normal_diff_thr)) continue;
-                }
-
-                num_inliers = get_inliers(inliers, lo_model, pts, thr, best_inls);
-
-                if (best_inls < num_inliers) {
-                    best_model = lo_model;
-                    best_inls = num_inliers;
-                } else if (best_inls == num_inliers) {
-                    break;
-                }
-            }
-
-            const double max_hyp = 3 * log(1 - 0.95) / log(1 - pow(float(best_inls) / pts_size, min_sample_size));
-//            printf("best_inls = %d  best_inls/pts_size = %f   max_hyp = %f\n", best_inls, 1.0f * best_inls / pts_size,
-//                   max_hyp);
-            if (!std::isinf(max_hyp) && max_hyp < max_iterations) {
-                max_iterations = static_cast<int>(max_hyp);
-//                printf("update max_iterations --> %d \n", max_iterations);
-            }
-        }
+    const double axis_norm = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axis_norm == 0) {
+        mem_tracker::delete_array(inliers, size);
+        return 0;
     }
-
-    delete[] min_sample;
-    delete[] inlier_sample;
-    // Update the inliers of best_model
-    if (best_inls != 0 && best_inls >= num_inliers) best_inls = get_inliers(inliers, best_model, pts, thr);
-    return best_inls;
+    for (int k = 0; k < 3; ++k) axis[k] /= axis_norm;
+    directions[0] = pd::Vec3f((float) axis[0], (float) axis[1], (float) axis[2]);
+
+    // The largest plane perpendicular to the first direction, such as a wall to the floor
+    const pd::PerpendicularConstraint constraint(directions[0], normal_diff_thr);
+    pd::UniformSampler sampler;
+    int inls;
+    if (weights != nullptr) {
+        const std::vector<int> tail = weight_tail(weights, size);
+        inls = pd::get_plane<pd::Pruning>(plane, inliers, pts.span(), thr, max_iterations, constraint, sampler, stats,
+                                          pd::PointWeights{weights, tail.data()});
+    } else {
+        inls = pd::get_plane<pd::Pruning>(plane, inliers, pts.span(), thr, max_iterations, constraint, sampler, stats);
+    }
+    mem_tracker::delete_array(inliers, size);
+    if (inls == 0) return 1;
+
+    // Its normal made exactly orthogonal to the first direction, the third one completes the frame
+    double second[3], along = 0;
+    for (int k = 0; k < 3; ++k) along += plane[k] * axis[k];
+    for (int k = 0; k < 3; ++k) second[k] = plane[k] - along * axis[k];
+    const double second_norm = std::sqrt(second[0] * second[0] + second[1] * second[1] + second[2] * second[2]);
+    if (second_norm == 0) return 1;
+    for (int k = 0; k < 3; ++k) second[k] /= second_norm;
+    directions[1] = pd::Vec3f((float) second[0], (float) second[1], (float) second[2]);
+    directions[2] = pd::Vec3f((float) (axis[1] * second[2] - axis[2] * second[1]),
+                              (float) (axis[2] * second[0] - axis[0] * second[2]),
+                              (float) (axis[0] * second[1] - axis[1] * second[0]));
+    return 3;
 }
 
 /**
@@ -601,7 +757,7 @@ get_plane(cv::Vec4f &best_model, bool *inliers, const cv::Mat &pts, float thr,
  * @return if the two planes are very close, return true, otherwise false
  */
 // 计算平面的归一化齐次坐标，计算对应分量的欧氏距离
-bool check_same_plane(cv::Vec4f &p1, cv::Vec4f &p2, double thr) {
+bool check_same_plane(const pd::Vec4f &p1, const pd::Vec4f &p2, double thr) {
     double hom1 = sqrt(p1[0] * p1[0] + p1[1] * p1[1] + p1[2] * p1[2] + p1[3] * p1[3]);
     double hom2 = sqrt(p2[0] * p2[0] + p2[1] * p2[1] + p2[2] * p2[2] + p2[3] * p2[3]);
     double p1a = p1[0] / hom1, p1b = p1[1] / hom1, p1c = p1[2] / hom1, p1d = p1[3] / hom1;
@@ -609,29 +765,3 @@ bool check_same_plane(cv::Vec4f &p1, cv::Vec4f &p2, double thr) {
     return (p1a - p2a) * (p1a - p2a) + (p1b - p2b) * (p1b - p2b) + (p1c - p2c) * (p1c - p2c) + (p1d - p2d) * (p1d - p2d)
            < thr; // 0.0000001
 }
-
-/**
- *
- * @param actual_plane
- * @param expect_normal
- * @param thr
- * @return
- */
-
- /*
- * 其实就是求解两个向量的夹角，当夹角小于给定阈值 则认为估计的平面法向与预计法向接近 预设的thr=0.06
- * 下面的代码编写方法可解释为：向量a,b (a*b-|a|*|b|)^2 <=thr*|a|*|b|?
- */
-bool check_same_normal(cv::Vec4f &actual_plane, cv::Vec3f &expect_normal, double thr) {
-    double dot = (actual_plane[0] * expect_normal[0] + actual_plane[1] * expect_normal[1] +
-                  actual_plane[2] * expect_normal[2]);
-    double sqr_modulu_a = (actual_plane[0] * actual_plane[0] + actual_plane[1] * actual_plane[1] +
-                         actual_plane[2] * actual_plane[2]);
-    double sqr_modulu_b = (expect_normal[0] * expect_normal[0] + expect_normal[1] * expect_normal[1] +
-                         expect_normal[2] * expect_normal[2]);
-    //double cos_sqr = dot * dot / (sqr_mold_a * sqr_mold_b);
-    //return (cos_sqr - 1) * (cos_sqr - 1) < thr;
-    double cos_sqr = dot * dot;
-    double sqr_modulu_ab = (sqr_modulu_a * sqr_modulu_b);  // 如果都为单位向量 则两个向量模长都为1
-    return (cos_sqr - sqr_modulu_ab) * (cos_sqr - sqr_modulu_ab) <= thr * sqr_modulu_ab;
-}
@@ -0,0 +1,34 @@
+#include "ransac_opencv.h"
+
+pd::PointCloud to_point_cloud(cv::InputArray &points3d, cv::Mat &buffer) {
+    buffer = points3d.getMat();
+    if (points3d.isVector()) {
+        buffer = cv::Mat((int) buffer.total(), 3, CV_32F, buffer.data);
+    } else {
+        if (buffer.channels() != 1)
+            buffer = buffer.reshape(1, (int) buffer.total()); // Convert to single channel
+        if (buffer.rows < buffer.cols)
+            transpose(buffer, buffer);
+        CV_CheckEQ(buffer.cols, 3, "Invalid dimension of point");
+        if (buffer.type() != CV_32F)
+            buffer.convertTo(buffer, CV_32F); // Use float to store data
+        if (!buffer.isContinuous())
+            buffer = buffer.clone();
+    }
+    return pd::PointCloud((const float *) buffer.data, buffer.rows);
+}
+
+void get_planes(cv::Mat &labels, std::vector<cv::Vec4f> &planes, cv::InputArray &points3d,
+                float thr, int max_iterations, int desired_num_planes, float grid_size, cv::Vec3f *normal,
+                double normal_diff_thr, RansacStats *stats, bool weighted, pd_search search) {
+    cv::Mat buffer;
+    pd::PointCloud points = to_point_cloud(points3d, buffer);
+
+    labels.create(points.size(), 1, CV_32S); // Keeps a caller provided buffer of the right shape
+    pd::Vec3f normal_;
+    if (normal != nullptr) normal_ = to_pd(*normal);
+    std::vector<pd::Vec4f> planes_;
+    get_planes((int *) labels.data, planes_, points, thr, max_iterations, desired_num_planes, grid_size,
+               normal != nullptr ? &normal_ : nullptr, normal_diff_thr, stats, weighted, search);
+    for (const pd::Vec4f &plane : planes_) planes.push_back(to_cv(plane));
+}
@@ -0,0 +1,42 @@
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <pthread.h>
+#include "detection_server.h"
+
+using namespace std;
+
+/*
+ * command syntax
+ */
+void usage() {
+    printf("Usage:  plane_detection_server socket_path [queue_capacity] [detectors]\n"
+           "\tsocket_path\t\t Unix domain socket to listen on\n"
+           "\tqueue_capacity\t\t Requests waiting for a detector before clients are held back (default 16)\n"
+           "\tdetectors\t\t Requests detected at the same time (default 1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    pd::ServerOptions options;
+    options.socket_path = argv[1];
+    if (argc > 2) options.queue_capacity = stoi(argv[2]);
+    if (argc > 3) options.detectors = stoi(argv[3]);
+
+    // Handle SIGINT and SIGTERM on this thread only, the server threads inherit the blocked mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    pd::DetectionServer server;
+    if (!server.start(options)) return 1;
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    server.stop();
+    return 0;
+}
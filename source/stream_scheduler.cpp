@@ -0,0 +1,146 @@
+#include "stream_scheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include "parallel.h"
+#include "profiler.h"
+
+namespace pd {
+
+struct StreamScheduler::Frame {
+    uint64_t number;
+    PointCloud points;
+    std::function<void(const FrameResult &)> done;
+    double submitted_at, deadline;
+};
+
+struct StreamScheduler::Stream {
+    StreamOptions options;
+    Detector detector;
+    std::deque<Frame> queue;
+    uint64_t next_frame = 0;
+    bool busy = false;  // A runner is detecting a frame of this stream
+    StreamStats stats;
+
+    explicit Stream(const StreamOptions &options) : options(options), detector(options.params) {}
+};
+
+StreamScheduler::StreamScheduler(int concurrency) : pending_(0), stopping_(false) {
+    if (concurrency <= 0) concurrency = get_num_threads();
+    for (int i = 0; i < concurrency; ++i) runners_.emplace_back(&StreamScheduler::runner_loop, this);
+}
+
+StreamScheduler::~StreamScheduler() {
+    wait_idle();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_.notify_all();
+    for (std::thread &runner : runners_) runner.join();
+}
+
+int StreamScheduler::add_stream(const StreamOptions &options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.emplace_back(new Stream(options));
+    return (int) streams_.size() - 1;
+}
+
+uint64_t StreamScheduler::submit(int stream_id, const PointCloud &points,
+                                 std::function<void(const FrameResult &)> done) {
+    std::vector<Frame> dropped;
+    uint64_t number;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stream &stream = *streams_.at(stream_id);
+        const double now = profiler::now_s();
+        number = stream.next_frame++;
+        stream.queue.push_back(Frame{number, points, std::move(done), now, now + stream.options.latency_budget_s});
+        ++pending_;
+        const int limit = stream.options.max_queued_frames;
+        while (limit > 0 && (int) stream.queue.size() > limit) {
+            dropped.push_back(std::move(stream.queue.front()));
+            stream.queue.pop_front();
+            ++stream.stats.dropped;
+            --pending_;
+        }
+    }
+    work_.notify_one();
+
+    for (Frame &frame : dropped) {
+        FrameResult result;
+        result.stream = stream_id;
+        result.frame = frame.number;
+        result.dropped = true;
+        if (frame.done) frame.done(result);
+    }
+    if (!dropped.empty()) idle_.notify_all();
+    return number;
+}
+
+void StreamScheduler::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+StreamStats StreamScheduler::stats(int stream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.at(stream)->stats;
+}
+
+void StreamScheduler::runner_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // Earliest deadline first among the streams that are not being detected, so frames of a stream stay in order
+        int next = -1;
+        double earliest = std::numeric_limits<double>::infinity();
+        for (int s = 0; s < (int) streams_.size(); ++s) {
+            const Stream &stream = *streams_[s];
+            if (!stream.busy && !stream.queue.empty() && (next < 0 || stream.queue.front().deadline < earliest)) {
+                next = s;
+                earliest = stream.queue.front().deadline;
+            }
+        }
+        if (next < 0) {
+            if (stopping_) return;
+            work_.wait(lock);
+            continue;
+        }
+
+        Stream &stream = *streams_[next];
+        Frame frame = std::move(stream.queue.front());
+        stream.queue.pop_front();
+        stream.busy = true;
+        lock.unlock();
+
+        FrameResult result;
+        result.stream = next;
+        result.frame = frame.number;
+        const double start = profiler::now_s();
+        {
+            PD_PROFILE_SCOPE_INDEX("stream_frame", next);
+            ScopedDeadline deadline(frame.deadline);
+            result.status = stream.detector.detect(frame.points);
+        }
+        const double end = profiler::now_s();
+        result.queue_s = start - frame.submitted_at;
+        result.latency_s = end - frame.submitted_at;
+        result.deadline_met = end <= frame.deadline;
+        result.labels = &stream.detector.labels();
+        result.planes = &stream.detector.planes();
+        if (frame.done) frame.done(result);
+
+        lock.lock();
+        ++stream.stats.frames;
+        if (!result.deadline_met) ++stream.stats.deadline_misses;
+        stream.stats.total_latency_s += result.latency_s;
+        stream.stats.max_latency_s = std::max(stream.stats.max_latency_s, result.latency_s);
+        stream.busy = false;
+        --pending_;
+        // The next frame of this stream may now start, and wait_idle may be done
+        work_.notify_all();
+        idle_.notify_all();
+    }
+}
+
+}  // namespace pd
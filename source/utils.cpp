@@ -1,4 +1,59 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
 #include "utils.h"
+#include "parallel.h"
+#include "profiler.h"
+
+/**
+ * PLY header of a point cloud with float x, y, z vertices
+ */
+static std::string ply_header(long long size, bool binary) {
+    return std::string("ply\n") +
+           (binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n") +
+           "comment Created by Where is my plane\n"
+           "element vertex " + std::to_string(size) + "\n"
+                                                      "property float x\n"
+                                                      "property float y\n"
+                                                      "property float z\n"
+                                                      "end_header\n";
+}
+
+/**
+ * Size in bytes of a PLY scalar type, 0 if unknown
+ */
+static int ply_type_size(const std::string &type) {
+    if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") return 1;
+    if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") return 2;
+    if (type == "int" || type == "uint" || type == "int32" || type == "uint32" ||
+        type == "float" || type == "float32")
+        return 4;
+    if (type == "double" || type == "float64") return 8;
+    return 0;
+}
+
+/**
+ * Write count text lines, line i formatted into a buffer of max_line bytes by format(i, buffer), which returns
+ * its length. Blocks of lines are formatted in parallel and written in order, a few blocks per thread at a time.
+ */
+template<typename Format>
+static void write_lines(std::ofstream &ofs, long long count, int max_line, const Format &format) {
+    const long long block = 1 << 14;
+    const int blocks_per_batch = 4 * pd::get_num_threads();
+    std::vector<std::string> text(blocks_per_batch);
+    for (long long first = 0; first < count; first += block * blocks_per_batch) {
+        const int blocks = (int) std::min<long long>(blocks_per_batch, (count - first + block - 1) / block);
+        pd::parallel_for(0, blocks, [&](int blocks_begin, int blocks_end) {
+            std::vector<char> line(max_line);
+            for (int b = blocks_begin; b < blocks_end; ++b) {
+                const long long begin = first + b * block, end = std::min(count, begin + block);
+                text[b].clear();
+                for (long long i = begin; i < end; ++i) text[b].append(line.data(), format(i, line.data()));
+            }
+        });
+        for (int b = 0; b < blocks; ++b) ofs.write(text[b].data(), (std::streamsize) text[b].size());
+    }
+}
 
 /**
  * Get the plane equation string ax + by + cz + d = 0
@@ -26,6 +81,7 @@ std::string get_plane_expression_str(cv::Vec4f model) {
  */
 // 这里使用了sync_with_stdio可以控制是否取消C++的输入缓存区
 bool save_points_label(const std::string &file_path, cv::InputArray &labels, bool sync_io) {
+    PD_PROFILE_SCOPE("save_labels");
     cv::Mat labels_m = labels.getMat();
 
     int size = labels_m.rows;
@@ -44,9 +100,9 @@ bool save_points_label(const std::string &file_path, cv::InputArray &labels, boo
 
     const int *myptr = (int *) labels_m.data;
 
-    for (int i = 0; i < size; ++i) {
-        ofs << myptr[i] << "\n";
-    }
+    write_lines(ofs, size, 16, [myptr](long long i, char *line) {
+        return snprintf(line, 16, "%d\n", myptr[i]);
+    });
 
     ofs.flush(); //刷新缓存区
     ofs.close();
@@ -55,14 +111,46 @@ bool save_points_label(const std::string &file_path, cv::InputArray &labels, boo
 }
 
 /**
- * Save point cloud label
+ * Read point cloud label, one integer per line as written by save_points_label
+ *
+ * @param labels  Label mat, n × 1, int type (output)
+ * @param file_path  Label file path
+ * @param sync_io  IO synchronization
+ * @return  true or false
+ */
+bool read_points_label(cv::Mat &labels, const std::string &file_path, bool sync_io) {
+    std::ios::sync_with_stdio(sync_io);
+
+    std::ifstream ifs(file_path);
+    if (!ifs.is_open()) {
+        std::cerr << "ifstream open file error!\n";
+        return false;
+    }
+
+    std::vector<int> values;
+    int label;
+    while (ifs >> label) values.push_back(label);
+    std::ios::sync_with_stdio(true);
+
+    if (values.empty()) {
+        std::cerr << "File read exception\n";
+        return false;
+    }
+    labels = cv::Mat((int) values.size(), 1, CV_32S);
+    std::copy(values.begin(), values.end(), (int *) labels.data);
+    return true;
+}
+
+/**
+ * Save point cloud as PLY
  *
  * @param file_path  Save path
  * @param pts   Point cloud
  * @param sync_io  IO synchronization
+ * @param binary  Write binary_little_endian instead of ascii
  * @return  true or false
  */
-bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, bool sync_io) {
+bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, bool sync_io, bool binary) {
     cv::Mat pts_m = pts.getMat();
     int size = pts_m.rows;
     if (size == 0) {
@@ -70,7 +158,7 @@ bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, boo
     }
 
     std::ios::sync_with_stdio(sync_io);
-    std::ofstream ofs(file_path);
+    std::ofstream ofs(file_path, binary ? std::ios::out | std::ios::binary : std::ios::out);
 
     if (!ofs.is_open()) {
         std::cerr << "ofstream open file error!\n";
@@ -78,22 +166,20 @@ bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, boo
     }
     ofs.clear();
 
-    std::string head = "ply\n"
-                       "format ascii 1.0\n"
-                       "comment Created by Where is my plane\n"
-                       "element vertex " + std::to_string(size) + "\n"
-                                                                  "property float x\n"
-                                                                  "property float y\n"
-                                                                  "property float z\n"
-                                                                  "end_header\n";
-    ofs << head;
+    ofs << ply_header(size, binary);
 
-    float *myptr = (float *) pts_m.data;
+    const float *myptr = (float *) pts_m.data;
 
 //    ofs << std::fixed << std::setprecision(2);
 
-    for (int i = 0; i < size; ++i) {
-        ofs << *(myptr++) << " " << *(myptr++) << " " << *(myptr++) << "\n";
+    if (binary) {
+        ofs.write((const char *) myptr, (std::streamsize) size * 3 * sizeof(float));
+    } else {
+        // %g is the default formatting of ofs << float, the file is the same as writing the points one by one
+        write_lines(ofs, size, 64, [myptr](long long i, char *line) {
+            const float *p = myptr + 3 * i;
+            return snprintf(line, 64, "%g %g %g\n", p[0], p[1], p[2]);
+        });
     }
 
     ofs.flush();
@@ -103,44 +189,123 @@ bool save_point_cloud_ply(const std::string &file_path, cv::InputArray &pts, boo
 }
 
 /**
- *  Get point cloud data
+ *  Get point cloud data, ascii or binary_little_endian PLY with float or double x, y, z vertex properties
  *
- * @param output  Point cloud (output)
+ * @param output  Point cloud (output), its buffer is reused when it already is a size × 3 float matrix
  * @param file_path  Save path
  * @param sync_io  IO synchronization
  * @return  true or false
  */
 bool read_point_cloud_ply_to_mat(cv::Mat &output, const std::string &file_path, bool sync_io) {
+    PD_PROFILE_SCOPE("read");
     std::ios::sync_with_stdio(sync_io);
 
-    std::ifstream ifs(file_path);
+    std::ifstream ifs(file_path, std::ios::in | std::ios::binary);
     if (!ifs.is_open()) {
         std::cerr << "ifstream open file error!\n";
         return false;
     }
 
-    std::string head;
-    int size = 0;
-    while (head != "end_header") {
-        if (head == "vertex") {
-            ifs >> size;
+    // Vertex properties in file order: byte size and, for x, y and z, the output column
+    struct Property {
+        int bytes, column;
+        bool is_double;
+    };
+    std::vector<Property> properties;
+    std::string line, format = "ascii";
+    int size = -1;
+    bool in_vertex = false;
+    while (std::getline(ifs, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream ls(line);
+        std::string key;
+        ls >> key;
+        if (key == "format") {
+            ls >> format;
+        } else if (key == "element") {
+            std::string name;
+            ls >> name;
+            in_vertex = name == "vertex";
+            if (in_vertex) ls >> size;
+        } else if (key == "property" && in_vertex) {
+            std::string type, name;
+            ls >> type >> name;
+            int bytes = ply_type_size(type);
+            if (bytes == 0) {
+                std::cerr << "Unsupported PLY property type " << type << "\n";
+                return false;
+            }
+            int column = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+            properties.push_back({bytes, column, type == "double" || type == "float64"});
+        } else if (key == "end_header") {
+            break;
         }
-        ifs >> head;
     }
 
-    if (size < 0) {
+    if (size < 0 || !ifs) {
         std::cerr << "File read exception\n";
         return false;
     }
+    // Older files written without property lines hold x, y, z only
+    if (properties.empty()) properties = {{4, 0, false}, {4, 1, false}, {4, 2, false}};
 
-    output = cv::Mat(size, 3, CV_32F);
-
+    output.create(size, 3, CV_32F); // Keeps the buffer of a recycled frame of the same size
     float *myptr = (float *) output.data;
-    size *= 3;
-    for (int i = 0; i < size; ++i) {
-        ifs >> myptr[i];
+
+    if (format == "ascii") {
+        const int num_properties = (int) properties.size();
+        if (num_properties == 3 && properties[0].column == 0 && properties[1].column == 1 &&
+            properties[2].column == 2) {
+            const long long total = 3LL * size;
+            for (long long i = 0; i < total; ++i) {
+                if (!(ifs >> myptr[i])) break;
+            }
+        } else {
+            double value;
+            for (int i = 0; i < size && ifs; ++i) {
+                for (int p = 0; p < num_properties; ++p) {
+                    if (!(ifs >> value)) break;
+                    if (properties[p].column >= 0) myptr[3 * i + properties[p].column] = (float) value;
+                }
+            }
+        }
+    } else if (format == "binary_little_endian") {
+        int stride = 0;
+        for (const Property &p : properties) stride += p.bytes;
+        // Read a block of vertices at a time
+        const int block = 1 << 16;
+        std::vector<char> buffer((size_t) stride * block);
+        for (int first = 0; first < size; first += block) {
+            const int count = std::min(block, size - first);
+            if (!ifs.read(buffer.data(), (std::streamsize) stride * count)) break;
+            for (int i = 0; i < count; ++i) {
+                const char *vertex = buffer.data() + (size_t) stride * i;
+                float *dst = myptr + 3 * (size_t) (first + i);
+                for (const Property &p : properties) {
+                    if (p.column >= 0) {
+                        if (p.is_double) {
+                            double value;
+                            memcpy(&value, vertex, sizeof(value));
+                            dst[p.column] = (float) value;
+                        } else {
+                            memcpy(dst + p.column, vertex, sizeof(float));
+                        }
+                    }
+                    vertex += p.bytes;
+                }
+            }
+        }
+    } else {
+        std::cerr << "Unsupported PLY format " << format << "\n";
+        return false;
     }
+
     std::ios::sync_with_stdio(true);
+    // A value or block that could not be read, the file holds fewer vertices than its header declares
+    if (ifs.fail()) {
+        std::cerr << "File read exception\n";
+        return false;
+    }
     return true;
 }
 
@@ -152,20 +317,23 @@ bool read_point_cloud_ply_to_mat(cv::Mat &output, const std::string &file_path,
  * @param noise_num  Indicates the number of additional noise points
  * @param models  Represents an array of all plane equations. Before passing in the parameters, 
  * you need to add a model equation of the form ax+by+cz+d=0 through models.push(Vec4f(a,b,c,d)) , The quantity does not need to be excessive
- * @param point_cloud  Means the generated point cloud
+ * @param point_cloud  Means the generated point cloud, (point_num + noise_num) × 3
+ * @param seed  Random seed, the same seed gives the same point cloud
  */
+// 每个平面沿法向量最大分量的坐标轴求解, 任意朝向的平面都可以生成; 与立方体不相交的平面的点改为噪声点
 void
-point_cloud_generator(float size, int point_num, int noise_num, std::vector<cv::Vec4f> models, cv::Mat &point_cloud) {
+point_cloud_generator(float size, int point_num, int noise_num, std::vector<cv::Vec4f> models, cv::Mat &point_cloud,
+                      uint64_t seed) {
     float *myptr = (float *) point_cloud.data;
-    cv::RNG rng((int) std::time(nullptr));
+    cv::RNG rng(seed);
 
     int ran_num;
     int res_num = point_num;
     int models_size = (int) models.size();
-    int per_num = point_num / models_size;
+    int per_num = models_size > 0 ? point_num / models_size : 0;
     int idx = 0;
     cv::Vec4f model;
-    float x, y, z;
+    float p[3];
     for (int i = 0; i < models_size; i++) {
         ran_num = per_num - rng.uniform(-per_num / 2, per_num / 2);
         if (i == models_size - 1) {
@@ -173,17 +341,36 @@ point_cloud_generator(float size, int point_num, int noise_num, std::vector<cv::
         }
         res_num -= ran_num;
         model = models.at(i);
+
+        // Solve the plane equation for the axis with the largest normal component
+        int axis = 0;
+        for (int k = 1; k < 3; ++k) if (fabs(model[k]) > fabs(model[axis])) axis = k;
+        if (model[axis] == 0) {
+            noise_num += ran_num;
+            continue;
+        }
+        const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+
+        int rejected = 0;
         for (int j = 0; j < ran_num; j++) {
-            x = rng.uniform(-size, size);
-            y = rng.uniform(-size, size);
-            z = -(model[0] * x + model[1] * y + model[3]) / model[2];
-            if (z > size || z < -size) {
+            p[u] = rng.uniform(-size, size);
+            p[v] = rng.uniform(-size, size);
+            p[axis] = -(model[u] * p[u] + model[v] * p[v] + model[3]) / model[axis];
+            if (p[axis] > size || p[axis] < -size) {
+                // A plane that misses the cube would never succeed, give its remaining points to the noise
+                if (++rejected > 1000) {
+                    std::cerr << "Plane " << i << " does not intersect the cube, " << ran_num - j
+                              << " points generated as noise\n";
+                    noise_num += ran_num - j;
+                    break;
+                }
                 j--;
                 continue;
             }
-            myptr[idx++] = x;
-            myptr[idx++] = y;
-            myptr[idx++] = z;
+            rejected = 0;
+            myptr[idx++] = p[0];
+            myptr[idx++] = p[1];
+            myptr[idx++] = p[2];
         }
     }
 
@@ -193,3 +380,177 @@ point_cloud_generator(float size, int point_num, int noise_num, std::vector<cv::
         myptr[idx++] = rng.uniform(-size, size);
     }
 }
+
+/**
+ * Random plane patches with uniformly distributed orientations
+ *
+ * @param num_patches  Number of patches
+ * @param size  Patch centers lie in [-size / 2, size / 2]^3, half extents in [0.2 size, 0.6 size]
+ * @param seed  Random seed
+ * @return  Patches
+ */
+std::vector<PlanePatch> random_plane_patches(int num_patches, float size, uint64_t seed) {
+    cv::RNG rng(seed);
+    std::vector<PlanePatch> patches;
+    for (int i = 0; i < num_patches; ++i) {
+        PlanePatch patch;
+        cv::Vec3f n;
+        do {
+            n = cv::Vec3f((float) rng.gaussian(1), (float) rng.gaussian(1), (float) rng.gaussian(1));
+        } while (n.dot(n) < 1e-6f);
+        patch.normal = n * (1.f / std::sqrt(n.dot(n)));
+        patch.center = cv::Vec3f(rng.uniform(-size / 2, size / 2), rng.uniform(-size / 2, size / 2),
+                                 rng.uniform(-size / 2, size / 2));
+        patch.half_width = rng.uniform(0.2f * size, 0.6f * size);
+        patch.half_height = rng.uniform(0.2f * size, 0.6f * size);
+        patches.push_back(patch);
+    }
+    return patches;
+}
+
+namespace {
+
+// Points are generated in chunks of this size, each with its own random stream, so the result does not depend
+// on the number of threads or on how the output is blocked
+const long long scene_chunk = 1 << 16;
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * Number of points of every patch, proportional to its area, followed by the outliers
+ * patch_end[k] is one past the global index of the last point of patch k, the last entry covers the outliers
+ */
+std::vector<long long> scene_layout(const SceneConfig &config) {
+    const int num_patches = (int) config.patches.size();
+    long long outliers = num_patches == 0 ? config.num_points
+                                          : (long long) ((double) config.num_points * config.outlier_ratio);
+    long long inliers = config.num_points - outliers;
+
+    double total_area = 0;
+    for (const PlanePatch &p : config.patches) total_area += (double) p.half_width * p.half_height;
+
+    std::vector<long long> patch_end;
+    long long assigned = 0;
+    for (int k = 0; k < num_patches; ++k) {
+        const PlanePatch &p = config.patches[k];
+        long long count = k == num_patches - 1 ? inliers - assigned
+                                               : (long long) (inliers * ((double) p.half_width * p.half_height /
+                                                                         total_area));
+        assigned += count;
+        patch_end.push_back(assigned);
+    }
+    patch_end.push_back(config.num_points);
+    return patch_end;
+}
+
+/*
+ * Generate the points with global indices [first, first + count), first must be a multiple of scene_chunk
+ */
+void generate_scene_block(float *xyz, int *labels, long long first, long long count, const SceneConfig &config,
+                          const std::vector<long long> &patch_end) {
+    const int num_patches = (int) config.patches.size();
+
+    // In-plane axes of every patch
+    std::vector<cv::Vec3f> u_axes, v_axes;
+    for (const PlanePatch &p : config.patches) {
+        cv::Vec3f n = p.normal * (1.f / std::sqrt(p.normal.dot(p.normal)));
+        cv::Vec3f helper = fabs(n[0]) < 0.9f ? cv::Vec3f(1, 0, 0) : cv::Vec3f(0, 1, 0);
+        cv::Vec3f u = helper - n * helper.dot(n);
+        u = u * (1.f / std::sqrt(u.dot(u)));
+        u_axes.push_back(u);
+        v_axes.push_back(cv::Vec3f(n[1] * u[2] - n[2] * u[1], n[2] * u[0] - n[0] * u[2], n[0] * u[1] - n[1] * u[0]));
+    }
+
+    const long long num_chunks = (count + scene_chunk - 1) / scene_chunk;
+    pd::parallel_for(0, (int) num_chunks, [&](int chunks_begin, int chunks_end) {
+        for (int c = chunks_begin; c < chunks_end; ++c) {
+            const long long begin = first + c * scene_chunk, end = std::min(first + count, begin + scene_chunk);
+            cv::RNG rng(splitmix64(config.seed ^ splitmix64((uint64_t) (begin / scene_chunk))));
+            int k = (int) (std::upper_bound(patch_end.begin(), patch_end.end(), begin) - patch_end.begin());
+            for (long long i = begin; i < end; ++i) {
+                while (i >= patch_end[k]) ++k;
+                float *dst = xyz + 3 * (i - first);
+                if (k < num_patches) {
+                    const PlanePatch &p = config.patches[k];
+                    const float a = rng.uniform(-p.half_width, p.half_width);
+                    const float b = rng.uniform(-p.half_height, p.half_height);
+                    const float offset = config.noise_sigma > 0 ? (float) rng.gaussian(config.noise_sigma) : 0.f;
+                    const cv::Vec3f n = p.normal * (1.f / std::sqrt(p.normal.dot(p.normal)));
+                    for (int j = 0; j < 3; ++j)
+                        dst[j] = p.center[j] + a * u_axes[k][j] + b * v_axes[k][j] + offset * n[j];
+                } else {
+                    for (int j = 0; j < 3; ++j) dst[j] = rng.uniform(-config.size, config.size);
+                }
+                if (labels != nullptr) labels[i - first] = k < num_patches ? k + 1 : 0;
+            }
+        }
+    });
+}
+
+}  // namespace
+
+/**
+ * Generate a synthetic scene of bounded plane patches, outliers and noise in memory
+ *
+ * The points of every patch are uniform over the patch, shifted along its normal by Gaussian noise. Patches get
+ * points in proportion to their area and are stored one after the other, followed by the outliers. Generation runs
+ * in parallel and the result only depends on the configuration, including the seed.
+ *
+ * @param point_cloud  Generated point cloud, num_points × 3 (output)
+ * @param labels  Patch of every point, k + 1 for patch k and 0 for outliers, num_points × 1, nullptr to skip (output)
+ * @param config  Scene configuration
+ */
+void generate_scene(cv::Mat &point_cloud, cv::Mat *labels, const SceneConfig &config) {
+    const std::vector<long long> patch_end = scene_layout(config);
+    point_cloud = cv::Mat((int) config.num_points, 3, CV_32F);
+    if (labels != nullptr) *labels = cv::Mat((int) config.num_points, 1, CV_32S);
+    generate_scene_block((float *) point_cloud.data, labels != nullptr ? (int *) labels->data : nullptr, 0,
+                         config.num_points, config, patch_end);
+}
+
+/**
+ * Generate a synthetic scene straight to a binary PLY file, block by block, so the scene does not need to fit in memory
+ *
+ * @param file_path  PLY output path
+ * @param config  Scene configuration, see generate_scene
+ * @param label_path  Label output path, one label per line as save_points_label, empty to skip
+ * @return  true or false
+ */
+bool generate_scene_ply(const std::string &file_path, const SceneConfig &config, const std::string &label_path) {
+    std::ofstream ofs(file_path, std::ios::out | std::ios::binary);
+    if (!ofs.is_open()) {
+        std::cerr << "ofstream open file error!\n";
+        return false;
+    }
+    std::ofstream label_ofs;
+    if (!label_path.empty()) {
+        label_ofs.open(label_path);
+        if (!label_ofs.is_open()) {
+            std::cerr << "ofstream open file error!\n";
+            return false;
+        }
+    }
+
+    ofs << ply_header(config.num_points, true);
+
+    const std::vector<long long> patch_end = scene_layout(config);
+    const long long block = 64 * scene_chunk;
+    std::vector<float> xyz(3 * (size_t) std::min(block, config.num_points));
+    std::vector<int> labels(label_path.empty() ? 0 : xyz.size() / 3);
+    for (long long first = 0; first < config.num_points; first += block) {
+        const long long count = std::min(block, config.num_points - first);
+        generate_scene_block(xyz.data(), labels.empty() ? nullptr : labels.data(), first, count, config, patch_end);
+        ofs.write((const char *) xyz.data(), (std::streamsize) (3 * count * sizeof(float)));
+        for (long long i = 0; i < count && !labels.empty(); ++i) label_ofs << labels[i] << "\n";
+        if (!ofs) {
+            std::cerr << "File write exception\n";
+            return false;
+        }
+    }
+    return true;
+}
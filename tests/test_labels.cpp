@@ -0,0 +1,78 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "plane_detection.h"
+
+/*
+ * Labels of pd_get_planes: label k must be the plane planes[k - 1], and the planes are in descending order of
+ * inliers. The scene has a small dense plane and a large sparse one; the downsampled search finds the sparse one
+ * first, the refinement on all points ranks the dense one first.
+ */
+int check_labels(const std::vector<float> &xyz, const pd_params &params, const char *name) {
+    const size_t n = xyz.size() / 3;
+    const float thr = params.threshold;
+    std::vector<int32_t> labels(n);
+    float planes[8];
+    size_t num_planes = 0;
+    if (pd_get_planes(xyz.data(), n, 0, &params, labels.data(), planes, 2, &num_planes) != PD_OK) {
+        printf("%s: pd_get_planes failed: %s\n", name, pd_last_error());
+        return 1;
+    }
+    if (num_planes != 2) {
+        printf("%s: expected 2 planes, got %zu\n", name, num_planes);
+        return 1;
+    }
+
+    int failed = 0, previous = -1;
+    for (size_t k = 1; k <= num_planes; ++k) {
+        const float *plane = planes + 4 * (k - 1);
+        const double norm = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        int labelled = 0, inliers = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const float *p = xyz.data() + 3 * i;
+            const double distance = std::fabs(plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3]) / norm;
+            labelled += labels[i] == (int32_t) k;
+            inliers += distance < thr;
+        }
+        printf("%s: plane %zu: %d points labelled, %d inliers\n", name, k, labelled, inliers);
+        if (labelled != inliers) ++failed;
+        if (previous >= 0 && labelled > previous) ++failed;
+        previous = labelled;
+    }
+    return failed;
+}
+
+int main() {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.f, 1.f), noise(-0.02f, 0.02f);
+    std::vector<float> xyz;
+    for (int i = 0; i < 6000; ++i) {
+        const float p[3] = {4 * unit(rng), 4 * unit(rng), noise(rng)};
+        xyz.insert(xyz.end(), p, p + 3);
+    }
+    for (int i = 0; i < 4000; ++i) {
+        const float p[3] = {20 * unit(rng), 20 * unit(rng), 5 + noise(rng)};
+        xyz.insert(xyz.end(), p, p + 3);
+    }
+    for (int i = 0; i < 100; ++i) {
+        const float p[3] = {20 * unit(rng), 20 * unit(rng), 10 + 20 * unit(rng)};
+        xyz.insert(xyz.end(), p, p + 3);
+    }
+    pd_params params;
+    pd_default_params(&params);
+    params.threshold = 0.1f;
+    params.desired_num_planes = 2;
+    params.grid_size = 0.2f;
+    int failed = check_labels(xyz, params, "ransac");
+    params.weighted = 1;
+    failed += check_labels(xyz, params, "weighted");
+    params.weighted = 0;
+    params.use_normal = 1;
+    params.normal[2] = 1;
+    params.search = PD_SEARCH_PROJECTION;
+    failed += check_labels(xyz, params, "projection");
+    params.search = PD_SEARCH_MANHATTAN;
+    failed += check_labels(xyz, params, "manhattan");
+    return failed == 0 ? 0 : 1;
+}